@@ -210,9 +210,13 @@ EX int dirdiff(int dd, int t) {
 
 EX int cellcount = 0;
 
+/** \brief the number of cells destroyed so far, to tell whether cell pointers kept elsewhere are still valid */
+EX int cells_destroyed = 0;
+
 EX void destroy_cell(cell *c) {
   tailored_delete(c);
   cellcount--;
+  cells_destroyed++;
   }
 
 EX cell *newCell(int type, heptagon *master) {
@@ -222,6 +226,7 @@ EX cell *newCell(int type, heptagon *master) {
   initcell(c);
   hybrid::will_link(c);
   cellcount++;
+  PROFILE_COUNT("cells allocated", 1);
   return c;
   }
 
@@ -328,6 +333,7 @@ EX void eumerge(cell* c1, int s1, cell *c2, int s2, bool mirror) {
   if(!c2) return;
   c1->move(s1) = c2; c1->c.setspin(s1, s2, mirror);
   c2->move(s2) = c1; c2->c.setspin(s2, s1, mirror);
+  note_link(c1, c2);
   }
 
 //  map<pair<eucoord, eucoord>, cell*> euclidean;
@@ -1176,49 +1182,183 @@ EX int heptdistance(cell *c1, cell *c2) {
   else return heptdistance(c1->master, c2->master);
   }
 
-map<pair<cell*, cell*>, int> saved_distances;
+/** \brief distances from a single source cell, as computed by BFS
+ *
+ *  Cells are stored in BFS order, so the cells in distance d form a contiguous range of lst.
+ *  The distances are found by an open addressing table of the cells in lst, local to the row.
+ */
+struct distance_row {
+  cell *source;
+  /** \brief parameters used to compute this row */
+  int max_range, climit;
+  /** \brief true if the BFS has not been cut by max_range or climit, i.e., the row is exact */
+  bool complete;
+  /** \brief rows computed for keep_distances_from are never evicted */
+  bool permanent;
+  /** \brief the neighbors in the LRU list (see distance_lru_first); only the rows which are not permanent are in the list */
+  distance_row *lru_prev, *lru_next;
+  /** \brief cells in BFS order */
+  vector<cell*> lst;
+  /** \brief cells in distance d are lst[layer_start[d]] .. lst[layer_start[d+1]-1] */
+  vector<int> layer_start;
+  /** \brief the table: the cell in each slot (NULL if empty), and its distance */
+  vector<cell*> keys;
+  vector<short> dist;
+  int bits;
+
+  distance_row() : source(nullptr), max_range(0), climit(0), complete(false), permanent(false), lru_prev(nullptr), lru_next(nullptr), bits(0) {}
+
+  int index(cell *c) const { return int(((unsigned long long) (size_t) c * 0x9E3779B97F4A7C15ull) >> (64 - bits)); }
+
+  /** \brief the slot of c, or the empty slot where it would be */
+  int find(cell *c) const {
+    int mask = isize(keys) - 1;
+    int i = index(c);
+    while(keys[i] && keys[i] != c) i = (i+1) & mask;
+    return i;
+    }
+
+  int distance_to(cell *c) const {
+    if(keys.empty()) return DISTANCE_UNKNOWN;
+    int i = find(c);
+    return keys[i] ? dist[i] : DISTANCE_UNKNOWN;
+    }
+
+  /** \brief the number of distances stored, for distance_row_budget */
+  int entries() const { return isize(lst); }
+
+  int max_distance() { return isize(layer_start) - 2; }
+  int count_at(int d) { return d < 0 || d > max_distance() ? 0 : layer_start[d+1] - layer_start[d]; }
+  cell *at_distance(int d, int i) { return lst[layer_start[d] + i]; }
+  bool covers(int mr, int cl) { return complete || (max_range >= mr && climit >= cl); }
+  };
+
+std::unordered_map<cell*, distance_row> distance_rows;
+
+/** \brief the most and the least recently used row which is not permanent */
+distance_row *distance_lru_first, *distance_lru_last;
 
 EX set<cell*> keep_distances_from;
 
-set<cell*> dists_computed;
+/** \brief the number of distances stored in the non-permanent rows */
+int distance_row_entries;
 
-int perma_distances;
+/** \brief least recently used rows are evicted when the non-permanent rows get larger than this */
+EX int distance_row_budget = 1000000;
+
+void lru_unlink(distance_row& r) {
+  (r.lru_prev ? r.lru_prev->lru_next : distance_lru_first) = r.lru_next;
+  (r.lru_next ? r.lru_next->lru_prev : distance_lru_last) = r.lru_prev;
+  r.lru_prev = r.lru_next = nullptr;
+  }
+
+void lru_push_front(distance_row& r) {
+  r.lru_prev = nullptr;
+  r.lru_next = distance_lru_first;
+  (distance_lru_first ? distance_lru_first->lru_prev : distance_lru_last) = &r;
+  distance_lru_first = &r;
+  }
+
+/** \brief mark r as the most recently used */
+void touch_distance_row(distance_row& r) {
+  if(r.permanent || distance_lru_first == &r) return;
+  lru_unlink(r);
+  lru_push_front(r);
+  }
+
+distance_row *find_distance_row(cell *c1) {
+  auto it = distance_rows.find(c1);
+  if(it == distance_rows.end() || it->second.lst.empty()) return nullptr;
+  return &it->second;
+  }
+
+void evict_distance_rows(distance_row *keep) {
+  while(distance_row_entries > distance_row_budget) {
+    distance_row *oldest = distance_lru_last;
+    if(oldest == keep) oldest = oldest->lru_prev;
+    if(!oldest) return;
+    lru_unlink(*oldest);
+    distance_row_entries -= oldest->entries();
+    distance_rows.erase(oldest->source);
+    }
+  }
+
+/** \brief get the distance row from c1, computing it if it does not cover the given range and count */
+distance_row& get_distance_row(cell *c1, int max_range, int climit) {
+  auto& r = distance_rows[c1];
+  if(!r.lst.empty() && r.covers(max_range, climit)) { touch_distance_row(r); return r; }
+
+  if(!r.lst.empty()) {
+    max_range = max(max_range, r.max_range);
+    climit = max(climit, r.climit);
+    if(!r.permanent) distance_row_entries -= r.entries(), lru_unlink(r);
+    }
+  r.source = c1;
+  r.max_range = max_range;
+  r.climit = climit;
 
-EX void compute_saved_distances(cell *c1, int max_range, int climit) {
-    
   celllister cl(c1, max_range, climit, NULL);
+  r.lst = cl.lst;
+  int N = isize(cl.lst);
+  r.complete = N < climit && cl.dists.back() < max_range;
+
+  r.layer_start.clear();
+  for(int i=0; i<N; i++)
+    while(isize(r.layer_start) <= cl.dists[i]) r.layer_start.push_back(i);
+  r.layer_start.push_back(N);
+
+  r.bits = 1;
+  while((1 << r.bits) < 2 * N) r.bits++;
+  r.keys.assign(1 << r.bits, nullptr);
+  r.dist.assign(1 << r.bits, -1);
+  for(int i=0; i<N; i++) {
+    int j = r.find(cl.lst[i]);
+    r.keys[j] = cl.lst[i];
+    r.dist[j] = cl.dists[i];
+    }
 
-  for(int i=0; i<isize(cl.lst); i++)
-    saved_distances[make_pair(c1, cl.lst[i])] = cl.dists[i];
+  if(!r.permanent) {
+    distance_row_entries += r.entries();
+    lru_push_front(r);
+    evict_distance_rows(&r);
+    }
+  return r;
+  }
+
+EX void compute_saved_distances(cell *c1, int max_range, int climit) {
+  get_distance_row(c1, max_range, climit);
   }
 
 EX void permanent_long_distances(cell *c1) {
   keep_distances_from.insert(c1);
-  if(racing::on)
-    compute_saved_distances(c1, 300, 1000000);
-  else
-    compute_saved_distances(c1, 120, 200000);
+  auto& r = racing::on ? get_distance_row(c1, 300, 1000000) : get_distance_row(c1, 120, 200000);
+  if(!r.permanent) {
+    r.permanent = true;
+    distance_row_entries -= r.entries();
+    lru_unlink(r);
+    }
   }
 
 EX void erase_saved_distances() {
-  saved_distances.clear(); dists_computed.clear();
-  
-  for(auto c: keep_distances_from) compute_saved_distances(c, 120, 200000);
-  perma_distances = isize(saved_distances);
+  for(auto it = distance_rows.begin(); it != distance_rows.end();)
+    if(it->second.permanent) ++it;
+    else it = distance_rows.erase(it);
+  distance_lru_first = distance_lru_last = nullptr;
+  distance_row_entries = 0;
   }
 
 EX int max_saved_distance(cell *c) {
-  int maxsd = 0;
-  for(auto& p: saved_distances) if(p.first.first == c) maxsd = max(maxsd, p.second);
-  return maxsd;
+  auto r = find_distance_row(c);
+  if(!r) return 0;
+  return r->max_distance();
   }
 
 EX cell *random_in_distance(cell *c, int d) {
-  vector<cell*> choices;
-  for(auto& p: saved_distances) if(p.first.first == c && p.second == d) choices.push_back(p.first.second);
-  println(hlog, "choices = ", isize(choices));
-  if(choices.empty()) return NULL;
-  return choices[hrand(isize(choices))];
+  auto r = find_distance_row(c);
+  int q = r ? r->count_at(d) : 0;
+  println(hlog, "choices = ", q);
+  if(!q) return NULL;
+  return r->at_distance(d, hrand(q));
   }
 
 EX int bounded_celldistance(cell *c1, cell *c2) {
@@ -1231,34 +1371,25 @@ EX int bounded_celldistance(cell *c1, cell *c2) {
     }
   #endif
 
-  if(saved_distances.count(make_pair(c1,c2)))
-    return saved_distances[make_pair(c1,c2)];
-
-  celllister cl(c1, 100, limit, NULL);
-  for(int i=0; i<isize(cl.lst); i++)
-    saved_distances[make_pair(c1, cl.lst[i])] = cl.dists[i];
-
-  if(saved_distances.count(make_pair(c1,c2)))
-    return saved_distances[make_pair(c1,c2)];
+  auto r = find_distance_row(c1);
+  if(r) {
+    int d = r->distance_to(c2);
+    if(d != DISTANCE_UNKNOWN || r->covers(100, limit)) {
+      touch_distance_row(*r);
+      return d;
+      }
+    }
 
-  return DISTANCE_UNKNOWN;
+  return get_distance_row(c1, 100, limit).distance_to(c2);
   }
 
 EX int clueless_celldistance(cell *c1, cell *c2) {
-  if(saved_distances.count(make_pair(c1,c2)))
-    return saved_distances[make_pair(c1,c2)];
-  
-  if(dists_computed.count(c1)) return DISTANCE_UNKNOWN;
-    
-  if(isize(saved_distances) > perma_distances + 1000000) erase_saved_distances();
-  compute_saved_distances(c1, 64, 1000);
-  
- dists_computed.insert(c1);
-
-  if(saved_distances.count(make_pair(c1,c2)))
-    return saved_distances[make_pair(c1,c2)];
-    
-  return DISTANCE_UNKNOWN;
+  auto r = find_distance_row(c1);
+  if(r) {
+    touch_distance_row(*r);
+    return r->distance_to(c2);
+    }
+  return get_distance_row(c1, 64, 1000).distance_to(c2);
   }
 
 EX int celldistance(cell *c1, cell *c2) {
@@ -1379,11 +1510,12 @@ EX void clearCellMemory() {
   allmaps.clear();
   currentmap = nullptr;
   last_cleared = NULL;
-  saved_distances.clear();
-  dists_computed.clear();
-  keep_distances_from.clear(); perma_distances = 0;
+  distance_rows.clear();
+  distance_lru_first = distance_lru_last = nullptr;
+  keep_distances_from.clear(); distance_row_entries = 0;
   pd_from = NULL;
   gp::gp_adj.clear();
+  slab_release();
   }
 
 auto cellhooks = addHook(hooks_clearmemory, 500, clearCellMemory);
@@ -1411,9 +1543,56 @@ struct adj_data {
   bool mirrored;
   transmatrix T;
   };
+
+/** a view of consecutive elements stored elsewhere */
+template<class T> struct span_of {
+  T *b, *e;
+  T* begin() const { return b; }
+  T* end() const { return e; }
+  size_t size() const { return e - b; }
+  bool empty() const { return b == e; }
+  T& operator[](int i) const { return b[i]; }
+  };
+
+/** results of adj_minefield_cells for the cells asked, stored in blocks which are never reallocated,
+ *  so that the spans returned remain valid until clear(); this is not called during get(), since the
+ *  recursive callers (uncoverMines, prespill, the electricity search) keep their spans */
+struct adj_cache {
+  struct entry {
+    span_of<adj_data> full;
+    span_of<cell*> cells;
+    };
+  std::unordered_map<cell*, entry> index;
+  vector<vector<adj_data>> full_blocks;
+  vector<vector<cell*>> cell_blocks;
+
+  template<class T> static span_of<T> add(vector<vector<T>>& blocks, const vector<T>& v) {
+    if(blocks.empty() || blocks.back().capacity() - blocks.back().size() < v.size()) {
+      blocks.emplace_back();
+      blocks.back().reserve(max<size_t>(v.size(), 1024));
+      }
+    auto& b = blocks.back();
+    size_t at = b.size();
+    b.insert(b.end(), v.begin(), v.end());
+    return span_of<T>{b.data() + at, b.data() + b.size()};
+    }
+
+  const entry& get(cell *c);
+
+  void clear() { index.clear(); full_blocks.clear(); cell_blocks.clear(); }
+  };
 #endif
 
-EX array<map<cell*, vector<adj_data>>, 2> adj_memo;
+/** the number of cells for which adj_memo keeps the results, checked by trim_adj_memo */
+EX int adj_memo_limit = 10000;
+
+/** separately for both values of mine_adjacency_rule; cleared on hooks_clearmemory and hooks_removecells */
+EX array<adj_cache, 2> adj_memo;
+
+/** clear adj_memo if it has grown over adj_memo_limit cells; called at the start of a turn and of a frame, where no spans are in use */
+EX void trim_adj_memo() {
+  for(auto& am: adj_memo) if(isize(am.index) > adj_memo_limit) am.clear();
+  }
 
 EX bool geometry_has_alt_mine_rule() {
   if(S3 >= OINF) return false;
@@ -1422,11 +1601,8 @@ EX bool geometry_has_alt_mine_rule() {
   return true;
   }
 
-EX vector<adj_data> adj_minefield_cells_full(cell *c) {
-  auto& am = adj_memo[mine_adjacency_rule];
-  if(am.count(c)) return am[c];
-  if(isize(am) > 10000) am.clear();
-  auto& res = am[c];
+vector<adj_data> compute_adj_minefield(cell *c) {
+  vector<adj_data> res;
   if(mine_adjacency_rule == 0 || !geometry_has_alt_mine_rule()) {
     forCellIdCM(c2, i, c) res.emplace_back(adj_data{c2, c->c.mirror(i), currentmap->adj(c, i)});
     }
@@ -1473,11 +1649,26 @@ EX vector<adj_data> adj_minefield_cells_full(cell *c) {
   return res;
   }
 
-EX vector<cell*> adj_minefield_cells(cell *c) {
-  vector<cell*> res;
-  auto ori = adj_minefield_cells_full(c);
-  for(auto p: ori) res.push_back(p.c);
-  return res;
+const adj_cache::entry& adj_cache::get(cell *c) {
+  auto it = index.find(c);
+  if(it != index.end()) return it->second;
+  auto full = compute_adj_minefield(c);
+  vector<cell*> cells;
+  for(auto& p: full) cells.push_back(p.c);
+  entry e;
+  e.full = add(full_blocks, full);
+  e.cells = add(cell_blocks, cells);
+  return index[c] = e;
+  }
+
+/** the cells adjacent to c according to mine_adjacency_rule, with the relative transformations; memoized in adj_memo */
+EX span_of<adj_data> adj_minefield_cells_full(cell *c) {
+  return adj_memo[mine_adjacency_rule].get(c).full;
+  }
+
+/** the cells adjacent to c according to mine_adjacency_rule; memoized in adj_memo */
+EX span_of<cell*> adj_minefield_cells(cell *c) {
+  return adj_memo[mine_adjacency_rule].get(c).cells;
   }
 
 EX vector<int> reverse_directions(cell *c, int dir) {
@@ -3374,12 +3374,183 @@ EX namespace ca {
   
   EX eWall wlive = waFloorA;
   
-  EX set<cell*> changed;
+  #if CAP_THREAD
+  /** the number of parts a generation is split into, computed in the thread pool (0 = one per thread) */
+  EX int threads = 0;
+  /** generations with fewer active cells are computed in the main thread */
+  EX int parallel_threshold = 65536;
+  #endif
+
+  /** The CA state is kept in arrays rather than in the cells, so that simulate(n) can compute
+   *  many generations without touching the cells. Cells are numbered in the order they are
+   *  first seen; the neighbors of cell i are adj[adj_start[i] .. adj_start[i]+adj_count[i]).
+   *  Only the active cells (those listed by list_adj, or next to a cell which has changed)
+   *  are updated. The walls are read when a cell is first used in a batch of generations,
+   *  and written back at the end of the batch.
+   */
+  struct engine {
+    vector<cell*> cells;
+    std::unordered_map<cell*, int> index;
+    vector<int> adj_start, adj_count, adj;
+    int adj_rule = -1;
+
+    /** alive (1) or not (0) */
+    vector<char> state;
+    /** the wall is neither wlive nor waNone, so it will be changed by the next update */
+    vector<char> other;
+    /** the land has been seen to be laCA */
+    vector<char> is_ca;
+    /** the last batch in which the state has been read from the cell */
+    vector<int> synced;
+    int batch = 0;
+
+    vector<int> active, current;
+    vector<char> is_active;
+    vector<char> next;
+
+    /** the cells whose state has changed in this batch */
+    vector<int> dirty;
+    vector<char> is_dirty;
+
+    void clear() { *this = engine(); }
+
+    int id(cell *c) {
+      auto p = index.emplace(c, isize(cells));
+      if(!p.second) return p.first->second;
+      cells.push_back(c);
+      adj_start.push_back(-1);
+      adj_count.push_back(0);
+      state.push_back(0);
+      other.push_back(0);
+      is_ca.push_back(0);
+      synced.push_back(-1);
+      is_active.push_back(0);
+      is_dirty.push_back(0);
+      return p.first->second;
+      }
+
+    /** read the state from the cell, unless it has been read already in this batch */
+    void sync(int i) {
+      if(synced[i] == batch) return;
+      synced[i] = batch;
+      auto w = cells[i]->wall;
+      state[i] = w == wlive;
+      other[i] = w != wlive && w != waNone;
+      }
+
+    void compute_adj(int i) {
+      if(adj_start[i] >= 0) return;
+      auto ls = adj_minefield_cells(cells[i]);
+      adj_start[i] = isize(adj);
+      adj_count[i] = isize(ls);
+      for(cell *c1: ls) {
+        int j = id(c1);
+        adj.push_back(j);
+        }
+      }
+
+    void activate(int i) {
+      if(!is_active[i]) is_active[i] = true, active.push_back(i);
+      }
+
+    /** the cell and its neighbors are updated in the next generation */
+    void activate_adj(int i) {
+      compute_adj(i);
+      activate(i);
+      for(int k=0; k<adj_count[i]; k++) activate(adj[adj_start[i]+k]);
+      }
+
+    /** forget everything except the active cells which have not been removed */
+    void forget(int rule) {
+      vector<cell*> cs;
+      for(int i: active) if(!is_cell_removed(cells[i])) cs.push_back(cells[i]);
+      clear();
+      adj_rule = rule;
+      for(cell *c: cs) activate(id(c));
+      }
+
+    void start_batch() {
+      if(adj_rule != mine_adjacency_rule) forget(mine_adjacency_rule);
+      batch++;
+      }
 
+    /** compute the next state of current[from..to); returns the number of live cells and of live neighbors */
+    pair<int, int> compute(const array<array<unsigned long long, 2>, MAX_NEIGHBOR>& rule, int from, int to) {
+      int old = 0, xold = 0;
+      for(int k=from; k<to; k++) {
+        int i = current[k];
+        if(!is_ca[i]) continue;
+        int live = 0;
+        const int *a = &adj[adj_start[i]];
+        for(int n=0; n<adj_count[i]; n++) live += state[a[n]];
+        next[k] = (rule[adj_count[i]][state[i]] >> live) & 1;
+        old += state[i], xold += live;
+        }
+      return {old, xold};
+      }
+
+    void step(const array<array<unsigned long long, 2>, MAX_NEIGHBOR>& rule) {
+      swap(current, active);
+      active.clear();
+      int qty = isize(current);
+      for(int i: current) {
+        is_active[i] = false;
+        if(!is_ca[i]) is_ca[i] = cells[i]->land == laCA;
+        if(!is_ca[i]) continue;
+        sync(i);
+        compute_adj(i);
+        for(int k=0; k<adj_count[i]; k++) sync(adj[adj_start[i]+k]);
+        }
+      next.resize(qty);
+
+      int old = 0, xold = 0;
+      #if CAP_THREAD
+      int nt = threads ? threads : tasks::size() + 1;
+      if(nt > 1 && qty >= parallel_threshold) {
+        std::atomic<int> aold(0), axold(0);
+        tasks::parallel_for(0, qty, (qty + nt - 1) / nt, [&] (int from, int to) {
+          auto r = compute(rule, from, to);
+          aold += r.first; axold += r.second;
+          });
+        old = aold; xold = axold;
+        }
+      else
+      #endif
+      tie(old, xold) = compute(rule, 0, qty);
+
+      for(int k=0; k<qty; k++) {
+        int i = current[k];
+        if(!is_ca[i]) continue;
+        if(next[k] == state[i] && !other[i]) continue;
+        state[i] = next[k];
+        other[i] = false;
+        if(!is_dirty[i]) is_dirty[i] = true, dirty.push_back(i);
+        /* new cells near the changed ones are generated dead */
+        dynamicval<ld> d(prob, 0);
+        setdist(cells[i], 7, nullptr);
+        activate_adj(i);
+        }
+      println(hlog, make_tuple(qty, old, xold, isize(active)));
+      }
+
+    void write_back() {
+      for(int i: dirty) {
+        cells[i]->wall = state[i] ? wlive : waNone;
+        is_dirty[i] = false;
+        }
+      dirty.clear();
+      }
+    };
+
+  engine the_engine;
+
+  /** call when the wall of c may have changed: c and its neighbors will be updated in the next generation */
   EX void list_adj(cell *c) {
-    changed.insert(c);
-    for(cell* c1: adj_minefield_cells(c))
-      changed.insert(c1);
+    auto& e = the_engine;
+    int i = e.id(c);
+    /* the engine's state is newer while it is running */
+    if(!e.is_dirty[i]) e.synced[i] = -1;
+    e.activate_adj(i);
     }
 
   // you can also do -mineadj
@@ -3410,7 +3581,7 @@ EX namespace ca {
     if(argis("-carun")) {
       shift(); int iter = argi();
       start_game();
-      for(int i=0; i<iter; i++) simulate();
+      simulate(iter);
       return 0;
       }
     if(args()[0] != '-') return 1;
@@ -3434,41 +3605,24 @@ EX namespace ca {
   auto ah = addHook(hooks_args, 0, readArg);
 #endif
 
-  EX void simulate() {
+  /** compute iter generations, and write the results to the cells */
+  EX void simulate(int iter IS(1)) {
     if(cwt.at->land != laCA) return;
     if(items[itOrbAether] < 2) items[itOrbAether] = 2;
-    vector<cell*> allcells;
-    for(cell *c: changed) allcells.push_back(c);
-    changed.clear();
-    int dcs = isize(allcells);
-    std::vector<bool> willlive(dcs);
-    int old = 0, xold = 0;
-    for(int i=0; i<dcs; i++) {
-      cell *c = allcells[i];
-      if(c->land != laCA) continue;
-      int nei = 0, live = 0;
-      for(cell *c2: adj_minefield_cells(c)) {
-        nei++; if(c2->wall == wlive) live++;
-        }
-      int welive = 0; if(c->wall == wlive) welive++;
-      willlive[i] = carule[nei][welive][live] == '1';
-      old += welive, xold += live;
-      }
-    for(int i=0; i<dcs; i++) {
-      cell *c = allcells[i];
-      auto last = c->wall;
-      c->wall = willlive[i] ? wlive : waNone;
-      if(c->wall != last) {
-        dynamicval<ld> d(prob, 0);
-        setdist(c, 7, nullptr);
-        list_adj(c);
-        }
+    array<array<unsigned long long, 2>, MAX_NEIGHBOR> rule;
+    for(int nei=0; nei<MAX_NEIGHBOR; nei++) for(int live=0; live<2; live++) {
+      rule[nei][live] = 0;
+      for(int k=0; k<MAX_NEIGHBOR; k++) if(carule[nei][live][k] == '1') rule[nei][live] |= 1ull << k;
       }
-    println(hlog, make_tuple(dcs, old, xold, isize(changed)));
+    auto& e = the_engine;
+    e.start_batch();
+    for(int i=0; i<iter; i++) e.step(rule);
+    e.write_back();
     }
 EX }
 
 auto ccm = addHook(hooks_clearmemory, 0, [] () {
+  ca::the_engine.clear();
   heat::offscreen_heat.clear();
   heat::offscreen_fire.clear();
   princess::clear();
@@ -3507,6 +3661,7 @@ auto ccm = addHook(hooks_clearmemory, 0, [] () {
     gd->store(elec::afterOrb);
     }) +
   addHook(hooks_removecells, 0, [] () {
+    ca::the_engine.forget(ca::the_engine.adj_rule);
     for(cell *c: removed_cells) clearing::score.erase(c);
     for(auto& am: adj_memo) am.clear();
     eliminate_if(heat::offscreen_heat, is_cell_removed);
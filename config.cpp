@@ -962,6 +962,8 @@ EX void initConfig() {
   param_b(vid.smart_area_based, "smart-area-based", false);
   param_i(vid.cells_drawn_limit, "limit on cells drawn", 10000);
   param_i(vid.cells_generated_limit, "limit on cells generated", 250);
+  param_b(visible_cache::on, "visible_cache", true);
+  param_f(visible_cache::max_drift, "visible_cache_drift", 1);
 
   param_enum(diskshape, "disk_shape", "disk_shape", dshTiles)
     ->editable({{"distance in tiles", ""}, {"distance in vertices", ""}, {"geometric distance", ""}
@@ -833,6 +833,27 @@ int read_cheat_args() {
     cheat();
     gen_wandering = false;
     }
+  else if(argis("-bfs-cache")) {
+    shift(); bfs_cache = argi();
+    }
+  else if(argis("-bfs-check")) {
+    bfs_crosscheck = true;
+    }
+  else if(argis("-distance-budget")) {
+    shift(); distance_row_budget = argi();
+    }
+  else if(argis("-slab-stats")) {
+    PHASEFROM(2);
+    print_slab_stats();
+    }
+  #if CAP_THREAD
+  else if(argis("-shmup-threads")) {
+    shift(); shmup::threads = argi();
+    }
+  #endif
+  else if(argis("-shmup-intents")) {
+    shift(); shmup::use_intents = argi();
+    }
   else if(argis("-canvasfloor")) {
     shift(); canvasfloor = argi();
     for(int i=0; i<caflEND; i++) if(appears(mapeditor::canvasFloorName(i), args()))
@@ -0,0 +1,367 @@
+// Headless benchmarks with fixed seeds, to compare the performance of builds.
+// Nothing is displayed: the benchmarks run while reading the command line, and HyperRogue exits afterwards.
+//
+// Usage: hyper -bench-reps 5 -bench-out results.json -bench
+// (-bench-only <substring> runs only the scenarios whose names contain the given substring;
+// without -bench-out, the JSON results are written to the log)
+//
+// Every repetition of every scenario starts a new game with the same seed, so the results
+// (including the 'check' value, which should be identical between builds) are repeatable.
+// Each scenario is first run -bench-warmup times (default 1) without timing, since the
+// first game in a process initializes some data lazily.
+// Times are wall-clock milliseconds; the peak RSS reported for a scenario is the peak
+// for the whole process so far.
+
+#include "../hyper.h"
+#include <chrono>
+#if !ISWINDOWS
+#include <sys/resource.h>
+#endif
+
+namespace hr {
+
+namespace bench {
+
+int reps = 5;
+int warmup = 1;
+int seed = 1;
+int cells = 20000;
+int turns = 200;
+int queries = 10000;
+int shmup_ticks = 200;
+string only;
+string output;
+string tes_file = "tessellations/sample/hr-standard-tiling.tes";
+
+/** land_structure is changed when switching to geometries which do not support it */
+eLandStructure land_structure0;
+
+struct scenario {
+  string name;
+  /** prepares a new game; not timed */
+  reaction_t setup;
+  /** the timed part; returns a value which should not depend on the build */
+  function<long long()> run;
+  };
+
+struct result {
+  string name;
+  vector<double> times;
+  vector<long long> checks;
+  long long peak_rss_kb;
+  string error;
+  };
+
+long long peak_rss_kb() {
+  #if ISWINDOWS
+  return -1;
+  #else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  #if ISMAC
+  return usage.ru_maxrss / 1024;
+  #else
+  return usage.ru_maxrss;
+  #endif
+  #endif
+  }
+
+/** start a new game with the benchmark seed, after resetting the mode and calling f */
+void new_game(const reaction_t& f) {
+  stop_game();
+  if(shmup::on) switch_game_mode(rg::shmup);
+  set_geometry(gNormal);
+  set_variation(eVariation::bitruncated);
+  firstland = specialland = laCrossroads;
+  land_structure = land_structure0;
+  f();
+  shrand(seed);
+  start_game();
+  }
+
+/** generate lands in the cells closest to the start, until `cells` new cells have been created */
+long long generate_cells() {
+  int cc = cellcount;
+  celllister cl(cwt.at, 1000, cells, nullptr);
+  for(cell *c: cl.lst) {
+    setdist(c, 7, nullptr);
+    if(cellcount - cc >= cells) break;
+    }
+  return cellcount - cc;
+  }
+
+void crowd(eLand l) {
+  firstland = specialland = l;
+  items[treasureType(l)] = 50;
+  items[itWarning] = 1;
+  }
+
+long long monster_turns() {
+  for(int i=0; i<turns; i++) {
+    if(!canmove) canmove = true;
+    int d = hrand(cwt.at->type);
+    if(!movepcto(d, 1, false)) movepcto(MD_WAIT, 1);
+    }
+  long long monsters = 0;
+  for(cell *c: dcal) if(c->monst) monsters++;
+  return monsters;
+  }
+
+vector<pair<cell*, cell*>> pairs;
+
+void prepare_pairs() {
+  celllister cl(cwt.at, 1000, 5000, nullptr);
+  for(cell *c: cl.lst) setdist(c, 7, nullptr);
+  pairs.clear();
+  for(int i=0; i<queries; i++)
+    pairs.emplace_back(cl.lst[hrand(isize(cl.lst))], cl.lst[hrand(isize(cl.lst))]);
+  }
+
+long long distance_storm() {
+  long long total = 0;
+  for(auto p: pairs) total += celldistance(p.first, p.second);
+  return total;
+  }
+
+vector<pair<hyperpoint, hyperpoint>> point_pairs;
+
+/** random pairs of points, at most 3 apart */
+void prepare_point_pairs() {
+  auto random_point = [] {
+    hyperpoint h = xspinpush0(hrandf() * 2 * M_PI, hrandf() * 3);
+    if(GDIM == 3) h = cspin(1, 2, hrandf() * 2 * M_PI) * h;
+    return h;
+    };
+  point_pairs.clear();
+  for(int i=0; i<queries; i++) point_pairs.emplace_back(random_point(), random_point());
+  }
+
+/** the basic geometric functions, roughly as in rug::force, for all the point pairs, using the geometry policy P */
+struct policy_work {
+  ld sum;
+  template<class P> void operator() (P) {
+    for(int it=0; it<10; it++)
+    for(auto& pp: point_pairs) {
+      const hyperpoint& a = pp.first;
+      const hyperpoint& b = pp.second;
+      transmatrix T = P::iso_inverse(P::rgpushxto0(a));
+      hyperpoint ie = P::inverse_exp(T * b);
+      hyperpoint c = P::normalize(P::rgpushxto0(a) * P::direct_exp(ie * .5));
+      sum += P::hdist(a, b) + P::zlevel(c) + P::intval(c, b) + P::hdist0(c);
+      }
+    }
+  };
+
+/** the check is the same for both versions */
+long long policy_check(ld sum) { return (long long) floor(sum * 1000 + .5); }
+
+/** the geometry is checked in every call */
+long long dispatch_per_call() {
+  policy_work w{0};
+  w(generic_policy());
+  return policy_check(w.sum);
+  }
+
+/** the geometry is checked once */
+long long dispatch_per_batch() {
+  policy_work w{0};
+  dispatch_geometry(w);
+  return policy_check(w.sum);
+  }
+
+long long shmup_loop() {
+  cmode = sm::NORMAL;
+  for(int i=0; i<shmup_ticks; i++) {
+    /* shmup::turn only processes the monsters in gmatrix, which is normally computed while drawing */
+    gmatrix.clear();
+    cells_drawn = 0;
+    cells_generated = 0;
+    just_gmatrix = true;
+    compute_graphical_distance();
+    make_actual_view();
+    currentmap->draw_all();
+    just_gmatrix = false;
+    if(!canmove) canmove = true;
+    shmup::turn(20);
+    }
+  return tkills() + isize(shmup::monstersAt);
+  }
+
+vector<scenario> scenarios() {
+  vector<scenario> res;
+  auto gen = [&] (string name, reaction_t f) {
+    res.push_back(scenario{"gen-" + name, [f] { new_game(f); }, generate_cells});
+    };
+  gen("standard", [] {});
+  gen("goldberg", [] { gp::param = gp::loc(2, 1); set_variation(eVariation::goldberg); });
+  gen("archimedean", [] {
+    arcm::archimedean_tiling at;
+    at.parse("3,4,7,4");
+    if(at.errors) throw hr_exception(at.errormsg);
+    set_geometry(gArchimedean);
+    arcm::current = at;
+    });
+  gen("arbitrile", [] {
+    set_geometry(gArbitrary);
+    arb::load(tes_file);
+    });
+  gen("reg3", [] { set_geometry(gSpace534); });
+  gen("nil", [] { set_geometry(gNil); });
+  gen("solv", [] { set_geometry(gSol); });
+
+  for(eLand l: {laHive, laGraveyard, laJungle})
+    res.push_back(scenario{"turns-" + string(linf[l].name), [l] { new_game([l] { crowd(l); }); }, monster_turns});
+
+  res.push_back(scenario{"celldistance-standard", [] { new_game([] {}); prepare_pairs(); }, distance_storm});
+  res.push_back(scenario{"celldistance-goldberg", [] { new_game([] { gp::param = gp::loc(2, 1); set_variation(eVariation::goldberg); }); prepare_pairs(); }, distance_storm});
+
+  for(eGeometry g: {gNormal, gSphere, gEuclid, gSpace534}) {
+    auto setup = [g] { new_game([g] { set_geometry(g); }); prepare_point_pairs(); };
+    res.push_back(scenario{"dispatch-call-" + string(ginf[g].shortname), setup, dispatch_per_call});
+    res.push_back(scenario{"dispatch-batch-" + string(ginf[g].shortname), setup, dispatch_per_batch});
+    }
+
+  res.push_back(scenario{"shmup-graveyard", [] { new_game([] { switch_game_mode(rg::shmup); crowd(laGraveyard); }); }, shmup_loop});
+  return res;
+  }
+
+result run(scenario& s) {
+  result r;
+  r.name = s.name;
+  try {
+    for(int i=0; i<warmup; i++) {
+      s.setup();
+      s.run();
+      }
+    for(int i=0; i<reps; i++) {
+      s.setup();
+      auto t0 = std::chrono::steady_clock::now();
+      long long check = s.run();
+      auto t1 = std::chrono::steady_clock::now();
+      r.times.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+      r.checks.push_back(check);
+      }
+    }
+  catch(hr_exception& e) {
+    r.error = e.what();
+    }
+  r.peak_rss_kb = peak_rss_kb();
+  return r;
+  }
+
+double percentile(vector<double> v, double p) {
+  if(v.empty()) return 0;
+  sort(v.begin(), v.end());
+  int i = int(ceil(p * isize(v))) - 1;
+  return v[max(i, 0)];
+  }
+
+string json_string(const string& s) {
+  string res = "\"";
+  for(char c: s) {
+    if(c == '"' || c == '\\') res += '\\';
+    if(c == '\n') { res += "\\n"; continue; }
+    res += c;
+    }
+  return res + "\"";
+  }
+
+/** the check value; all the repetitions should give the same one */
+string checks_string(const result& r) {
+  string s = format("%lld", r.checks[0]);
+  for(auto c: r.checks) if(c != r.checks[0]) return json_string("varies");
+  return s;
+  }
+
+void write_results(hstream& f, const vector<result>& results) {
+  println(f, "{");
+  println(f, "  \"version\": ", json_string(VER), ",");
+  println(f, "  \"seed\": ", seed, ", \"warmup\": ", warmup, ", \"reps\": ", reps, ", \"cells\": ", cells, ", \"turns\": ", turns, ", \"queries\": ", queries, ", \"shmup_ticks\": ", shmup_ticks, ",");
+  println(f, "  \"scenarios\": [");
+  for(int i=0; i<isize(results); i++) {
+    auto& r = results[i];
+    print(f, "    {\"name\": ", json_string(r.name));
+    if(r.error != "")
+      print(f, ", \"error\": ", json_string(r.error));
+    else
+      print(f, ", \"median_ms\": ", format("%.3f", percentile(r.times, .5)), ", \"p95_ms\": ", format("%.3f", percentile(r.times, .95)),
+        ", \"min_ms\": ", format("%.3f", percentile(r.times, 0)), ", \"check\": ", checks_string(r));
+    print(f, ", \"peak_rss_kb\": ", format("%lld", r.peak_rss_kb), "}");
+    println(f, i < isize(results)-1 ? "," : " ");
+    }
+  println(f, "  ],");
+  println(f, "  \"peak_rss_kb\": ", format("%lld", peak_rss_kb()));
+  println(f, "}");
+  }
+
+void run_all() {
+  autocheat = true;
+  land_structure0 = land_structure;
+  vector<result> results;
+  for(auto& s: scenarios()) {
+    if(only != "" && s.name.find(only) == string::npos) continue;
+    results.push_back(run(s));
+    auto& r = results.back();
+    if(r.error != "")
+      println(hlog, lalign(24, r.name), " error: ", r.error);
+    else
+      println(hlog, lalign(24, r.name), " median ", lalign(10, format("%.3f", percentile(r.times, .5))),
+        " p95 ", lalign(10, format("%.3f", percentile(r.times, .95))), " check ", checks_string(r));
+    }
+  if(output != "") {
+    fhstream f(output, "wt");
+    if(!f.f) { println(hlog, "could not write to ", output); exit(1); }
+    write_results(f, results);
+    }
+  else write_results(hlog, results);
+  bool errors = false;
+  for(auto& r: results) if(r.error != "") errors = true;
+  exit(errors ? 1 : 0);
+  }
+
+int readArgs() {
+  using namespace arg;
+
+  if(0) ;
+  else if(argis("-bench")) {
+    PHASEFROM(2);
+    run_all();
+    }
+  else if(argis("-bench-only")) {
+    shift(); only = args();
+    }
+  else if(argis("-bench-out")) {
+    shift(); output = args();
+    }
+  else if(argis("-bench-reps")) {
+    shift(); reps = max(argi(), 1);
+    }
+  else if(argis("-bench-warmup")) {
+    shift(); warmup = argi();
+    }
+  else if(argis("-bench-seed")) {
+    shift(); seed = argi();
+    }
+  else if(argis("-bench-cells")) {
+    shift(); cells = argi();
+    }
+  else if(argis("-bench-turns")) {
+    shift(); turns = argi();
+    }
+  else if(argis("-bench-queries")) {
+    shift(); queries = argi();
+    }
+  else if(argis("-bench-shmup")) {
+    shift(); shmup_ticks = argi();
+    }
+  else if(argis("-bench-tes")) {
+    shift(); tes_file = args();
+    }
+  else return 1;
+  return 0;
+  }
+
+auto hooks = addHook(hooks_args, 100, readArgs);
+
+}
+}
@@ -17,14 +17,22 @@
 // Add e.g. '-dim 128 128 128' before -write to generate
 // a more/less precise table.
 
+// [executable] -geo sol -solv-table-build solv-geodesics.dat -exit
+// does -build and -write in one step, printing the progress. The computed z-slices
+// are saved in solv-geodesics.dat.part, so if it is interrupted, running the same
+// command again continues from where it stopped.
+
+// [executable] -geo sol -solv-table-check solv-geodesics.dat
+// verifies the checksum of a table.
+
 // # ./hyper -rk-steps 100 -geo Sol -iz-list -sn-unittest -build -write solv-geodesics-a.dat -visualize devmods/san1/solva-%04d.png -improve -write solv-geodesics.dat -visualize devmods/san1/solvb-%04d.png
 // # ./hyper -dim 32 32 32 -geo 3:1/2 -iz-list -sn-unittest -build -write ssol-geodesics-a.dat -visualize devmods/san1/ssola-%04d.png -improve -write ssol-geodesics.dat -visualize devmods/san1/ssolb-%04d.png
 // # ./hyper -dim 32 32 32 -geo 3:2 -iz-list -sn-unittest -build -write shyp-geodesics.dat -visualize devmods/san1/shypa-%04d.png
 
 #include "../hyper.h"
 
-#include <thread>
 #include <mutex>
+#include <chrono>
 
 namespace hr {
 
@@ -32,13 +40,8 @@ transmatrix parabolic1(ld u);
 
 namespace sn {
 
-template<class T> void parallelize(int threads, int Nmin, int Nmax, T action) {
-  std::vector<std::thread> v;
-  for(int k=0; k<threads; k++)
-    v.emplace_back([&,k] () { 
-      for(int i=Nmin+k; i < Nmax; i += threads) action(k, i);
-      });
-  for(std::thread& t:v) t.join();
+template<class T> void parallelize(int Nmin, int Nmax, T action) {
+  tasks::parallel_for(Nmin, Nmax, 1, [&] (int a, int b) { for(int i=a; i<b; i++) action(i); });
   }
 
 ld solerror(hyperpoint ok, hyperpoint chk) {
@@ -152,10 +155,10 @@ void ffloat(FILE *f, float x) { fwrite(&x, sizeof(x), 1, f); }
 
 void write_table(sn::tabled_inverses& tab, const char *fname) {
   FILE *f = fopen(fname, "wb");
-  fint(f, tab.PRECX);
-  fint(f, tab.PRECY);
-  fint(f, tab.PRECZ);
-  fwrite(&tab.tab[0], sizeof(ptlow) * tab.PRECX * tab.PRECY * tab.PRECZ, 1, f);
+  if(!f) throw hr_exception("cannot write " + string(fname));
+  auto h = tab.header(true);
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(tab.data, sizeof(ptlow) * tab.size(), 1, f);
   fclose(f);
   }
 
@@ -163,9 +166,72 @@ void alloc_table(sn::tabled_inverses& tab, int X, int Y, int Z) {
   tab.PRECX = X;
   tab.PRECY = Y;
   tab.PRECZ = Z;
+  tab.tab.clear();
   tab.tab.resize(X*Y*Z);
+  tab.data = &tab.tab[0];
+  tab.mapped = nullptr;
+  tab.checksum = 0;
+  tab.loaded = true;
+  tab.toload = true;
   }
 
+/** the z-slices of a table being built, saved after each slice, so that an interrupted build can be resumed.
+ *  The file is the table file (with checksum 0), followed by one byte for each slice, 1 if it is done.
+ */
+struct build_progress {
+  FILE *f;
+  sn::tabled_inverses *tab;
+  vector<char> done;
+  int slices_done;
+  std::chrono::steady_clock::time_point start;
+  std::mutex lock;
+
+  int slice_size() { return tab->PRECX * tab->PRECY; }
+  long flags_offset() { return sizeof(sn::table_header) + sizeof(ptlow) * tab->size(); }
+
+  build_progress(sn::tabled_inverses& t, const string& fname) : tab(&t), done(t.PRECZ, 0), slices_done(0) {
+    auto h = tab->header(false);
+    f = fopen(fname.c_str(), "r+b");
+    if(f) {
+      sn::table_header h1;
+      bool ok = fread(&h1, sizeof(h1), 1, f) == 1 && memcmp(&h, &h1, sizeof(h)) == 0;
+      ok = ok && fread(tab->data, sizeof(ptlow) * tab->size(), 1, f) == 1;
+      ok = ok && fread(&done[0], tab->PRECZ, 1, f) == 1;
+      if(!ok) {
+        println(hlog, fname, " is from another build, starting from scratch");
+        fclose(f); f = nullptr;
+        for(auto& d: done) d = 0;
+        }
+      }
+    if(!f) {
+      f = fopen(fname.c_str(), "w+b");
+      if(!f) throw hr_exception("cannot write " + fname);
+      fwrite(&h, sizeof(h), 1, f);
+      fwrite(tab->data, sizeof(ptlow) * tab->size(), 1, f);
+      fwrite(&done[0], tab->PRECZ, 1, f);
+      fflush(f);
+      }
+    for(auto d: done) if(d) slices_done++;
+    if(slices_done) println(hlog, "resuming: ", slices_done, " of ", tab->PRECZ, " slices already computed");
+    start = std::chrono::steady_clock::now();
+    }
+
+  void finished(int iz) {
+    std::lock_guard<std::mutex> fm(lock);
+    fseek(f, sizeof(sn::table_header) + sizeof(ptlow) * slice_size() * iz, SEEK_SET);
+    fwrite(&tab->get_int(0, 0, iz), sizeof(ptlow) * slice_size(), 1, f);
+    done[iz] = 1;
+    fseek(f, flags_offset() + iz, SEEK_SET);
+    fwrite(&done[iz], 1, 1, f);
+    fflush(f);
+    slices_done++;
+    ld elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    println(hlog, format("slice %3d: %d/%d done, %.0f s elapsed", iz, slices_done, tab->PRECZ, elapsed));
+    }
+
+  ~build_progress() { if(f) fclose(f); }
+  };
+
 ld ptd(ptlow p) {
   return p[0]*p[0] + p[1]*p[1] + p[2] * p[2];
   }
@@ -193,13 +259,15 @@ void fix_boundaries(sn::tabled_inverses& tab, int last_x, int last_y, int last_z
     tab.get_int(x,y,z) = tab.get_int(x-1,y,z) * 2 - tab.get_int(x-2,y,z);
   }
 
-void build_sols(int PRECX, int PRECY, int PRECZ) {
+void build_sols(int PRECX, int PRECY, int PRECZ, const string& progress_file = "") {
   std::mutex file_mutex;
   ld max_err = 0;
   auto& tab = sn::get_tabled();
   alloc_table(tab, PRECX, PRECY, PRECZ);
+  unique_ptr<build_progress> progress;
+  if(progress_file != "") progress = unique_ptr<build_progress>(new build_progress(tab, progress_file));
   int last_x = PRECX-1, last_y = PRECY-1, last_z = PRECZ-1;
-  auto act = [&] (int tid, int iz) {
+  auto act0 = [&] (int iz) {
     if((nih && iz == 0) || iz == PRECZ-1) return;
   
     auto solve_at = [&] (int ix, int iy) {
@@ -269,7 +337,13 @@ void build_sols(int PRECX, int PRECY, int PRECZ) {
       }
     };
 
-  parallelize(PRECZ, 0, PRECZ, act);
+  auto act = [&] (int iz) {
+    if(progress && progress->done[iz]) return;
+    act0(iz);
+    if(progress) progress->finished(iz);
+    };
+
+  parallelize(0, PRECZ, act);
   
   fix_boundaries(tab, last_x, last_y, last_z);
   }
@@ -480,7 +554,7 @@ void improve(sn::tabled_inverses& tab) {
   int last_x = PRECX-1, last_y = PRECY-1, last_z = PRECZ-1;
 
   max_iter = 1000;
-  auto act = [&] (int tid, int iz) {
+  auto act = [&] (int iz) {
     if((nih && iz == 0) || iz == PRECZ-1) return;
     for(int iy=0; iy<last_y; iy++)
     for(int ix=0; ix<last_x; ix++) {
@@ -505,7 +579,7 @@ void improve(sn::tabled_inverses& tab) {
     };
   max_iter = 1000000;
   
-  parallelize(PRECZ, 0, PRECZ, act);
+  parallelize(0, PRECZ, act);
   if(deb) exit(7);
 
 
@@ -534,7 +608,7 @@ int readArgs() {
     sn::get_tabled().load();
     }
   else if(argis("-improve")) {
-    sn::get_tabled().load();
+    sn::get_tabled().make_writable();
     improve(sn::get_tabled());
     }
   else if(argis("-write")) {
@@ -542,9 +616,26 @@ int readArgs() {
     write_table(sn::get_tabled(), argcs());
     }
   else if(argis("-fix-bugs")) {
-    sn::get_tabled().load();
+    sn::get_tabled().make_writable();
     fix_bugs(sn::get_tabled());
     }
+  else if(argis("-solv-table-build")) {
+    PHASEFROM(2);
+    shift(); string fname = args();
+    build_sols(dimX, dimY, dimZ, fname + ".part");
+    write_table(sn::get_tabled(), fname.c_str());
+    remove((fname + ".part").c_str());
+    println(hlog, "written ", fname);
+    }
+  else if(argis("-solv-table-check")) {
+    PHASEFROM(2);
+    shift();
+    auto& tab = sn::get_tabled();
+    tab.fname = args(); tab.loaded = false;
+    bool ok = tab.verify();
+    println(hlog, tab.fname, ": ", tab.PRECX, "x", tab.PRECY, "x", tab.PRECZ, ok ? " OK" : " checksum mismatch");
+    if(!ok) exit(1);
+    }
   else if(argis("-iz-list")) {
     sn::get_tabled().load();    
     for(int iz=0; iz<dimZ-1; iz++)
@@ -26,6 +26,25 @@ string test_eq(transmatrix T1, transmatrix T2, ld err = 1e-6) {
     }
   }
 
+/** compare the geometry policy P with the usual functions */
+struct policy_compare {
+  int bad;
+  template<class P> void operator() (P) {
+    for(int i=0; i<1000; i++) {
+      hyperpoint a = xspinpush0(randd() * 2 * M_PI, randd() * 3);
+      hyperpoint b = xspinpush0(randd() * 2 * M_PI, randd() * 3);
+      if(GDIM == 3) a = cspin(1, 2, randd() * 2 * M_PI) * a;
+      hyperpoint v = inverse_exp(shiftless(b));
+      auto differ = [] (ld x, ld y) { return abs(x - y) > 1e-12 * (1 + abs(x)); };
+      if(differ(P::hdist(a, b), hdist(a, b)) || differ(P::hdist0(a), hdist0(a)) || differ(P::zlevel(a), zlevel(a)) || differ(P::intval(a, b), intval(a, b))) bad++;
+      if(!eqmatrix(P::iso_inverse(P::rgpushxto0(a)), iso_inverse(rgpushxto0(a)), 1e-12)) bad++;
+      if(sqhypot_d(MDIM, P::inverse_exp(b) - v) > 1e-24) bad++;
+      if(sqhypot_d(MDIM, P::direct_exp(v) - direct_exp(v)) > 1e-24) bad++;
+      if(sqhypot_d(MDIM, P::normalize(a * 2) - normalize(a * 2)) > 1e-24) bad++;
+      }
+    }
+  };
+
 int readArgs() {
   using namespace arg;
            
@@ -104,7 +123,241 @@ int readArgs() {
     if(errors) exit(1);
     }
 
-  else if(argis("-partest", [] {
+  else if(argis("-test-batch")) {
+    /* applymodel_batch should agree with applying the matrix and the model to every point separately */
+    PHASEFROM(3);
+    dynamicval<eModel> dm(pmodel, pmodel);
+    for(eGeometry g: {gNormal, gSphere, gEuclid, gSpace534, gCubeTiling, gNil}) for(eModel md: {mdDisk, mdPerspective, mdBand}) {
+      stop_game();
+      set_geometry(g);
+      start_game();
+      if(md == mdPerspective && GDIM == 2) continue;
+      if(md == mdBand && GDIM == 3) continue;
+      pmodel = md;
+      for(ld angle: {0, 30}) {
+        pconf.camera_angle = angle;
+        auto random_point = [] {
+          if(nonisotropic) return point31(randd() - .5, randd() - .5, randd() - .5);
+          hyperpoint h = xspinpush0(randd() * 2 * M_PI, randd() * 2);
+          if(GDIM == 3) h = cspin(1, 2, randd() * 2 * M_PI) * h;
+          return h;
+          };
+        shiftmatrix V = shiftless(rgpushxto0(random_point()) * spin(randd() * 2 * M_PI));
+        vector<glvertex> tab;
+        for(int i=0; i<1000; i++) tab.push_back(glhr::pointtogl(random_point()));
+        vector<hyperpoint> H(isize(tab), Hypc), ret(isize(tab), Hypc);
+        applymodel_batch(V, tab.data(), isize(tab), H.data(), ret.data());
+        int bad = 0;
+        auto differ = [] (const hyperpoint& h1, const hyperpoint& h2, int dim) {
+          for(int j=0; j<dim; j++) if(abs(h1[j] - h2[j]) > 1e-9 * (1 + abs(h1[j]))) return true;
+          return false;
+          };
+        for(int i=0; i<isize(tab); i++) {
+          shiftpoint h = V * glhr::gltopoint(tab[i]);
+          hyperpoint r = Hypc;
+          applymodel(h, r);
+          if(differ(h.h, H[i], MXDIM) || differ(r, ret[i], MAXMDIM)) bad++;
+          }
+        println(hlog, "batch ", full_geometry_name(), " ", models::get_model_name(md), " camera angle ", angle, ": ", bad ? "ERROR" : "OK");
+        if(bad) errors++;
+        }
+      pconf.camera_angle = 0;
+      }
+    if(errors) exit(1);
+    }
+
+  else if(argis("-test-policy")) {
+    /* the geometry policies should give the same results as the usual functions */
+    PHASEFROM(3);
+    for(eGeometry g: {gNormal, gSphere, gEuclid, gSpace534, gCell120, gCubeTiling}) {
+      stop_game();
+      set_geometry(g);
+      start_game();
+      policy_compare c{0};
+      dispatch_geometry(c);
+      println(hlog, "policy ", full_geometry_name(), ": ", c.bad ? "ERROR" : "OK");
+      if(c.bad) errors++;
+      }
+    if(errors) exit(1);
+    }
+
+#if CAP_THREAD
+  else if(argis("-test-tasks")) {
+    /* each element is set exactly once, also in nested loops */
+    vector<int> v(100000);
+    tasks::parallel_for(0, isize(v), 0, [&] (int a, int b) { for(int i=a; i<b; i++) v[i]++; });
+    tasks::parallel_for(0, 100, 1, [&] (int a, int b) {
+      tasks::parallel_for(a * 1000, b * 1000, 100, [&] (int a1, int b1) { for(int i=a1; i<b1; i++) v[i]++; });
+      });
+    int bad = 0;
+    for(int x: v) if(x != 2) bad++;
+    println(hlog, "parallel_for: ", bad ? "ERROR" : "OK", " (", tasks::size(), " worker threads)");
+    if(bad) errors++;
+
+    bool caught = false;
+    try { tasks::parallel_for(0, 100, 1, [] (int a, int b) { if(a == 50) throw hr_exception("test"); }); }
+    catch(hr_exception&) { caught = true; }
+    println(hlog, "exception in parallel_for: ", caught ? "OK" : "ERROR");
+    if(!caught) errors++;
+
+    vector<tasks::future<long long>> fs;
+    for(int k=0; k<20; k++) fs.push_back(tasks::async([k] { long long s = 0; for(int i=0; i<=k*1000; i++) s += i; return s; }));
+    bad = 0;
+    for(int k=0; k<20; k++) if(fs[k].get() != (k*1000LL) * (k*1000+1) / 2) bad++;
+    println(hlog, "async: ", bad ? "ERROR" : "OK");
+    if(bad) errors++;
+
+    /* block the workers, so that the tasks submitted later are still waiting when cancelled */
+    std::atomic<bool> release(false);
+    std::atomic<int> blocked(0);
+    vector<tasks::future<void>> blockers;
+    for(int i=0; i<tasks::size(); i++) blockers.push_back(tasks::async([&] { blocked++; while(!release) std::this_thread::yield(); }, true));
+    while(blocked < tasks::size()) std::this_thread::yield();
+    auto fc = tasks::async([] { return 1; });
+    auto fp = tasks::async([] { return 2; }, true);
+    tasks::cancel_all();
+    release = true;
+    caught = false;
+    try { fc.get(); } catch(hr_exception&) { caught = true; }
+    bool ok = caught && fp.get() == 2;
+    for(auto& b: blockers) b.wait();
+    println(hlog, "cancellation: ", ok ? "OK" : "ERROR");
+    if(!ok) errors++;
+
+    /* the persistent tasks are not taken by the threads waiting in parallel_for */
+    release = false; blocked = 0; blockers.clear();
+    for(int i=0; i<tasks::size(); i++) blockers.push_back(tasks::async([&] { blocked++; while(!release) std::this_thread::yield(); }, true));
+    while(blocked < tasks::size()) std::this_thread::yield();
+    auto fid = tasks::async([] { return std::this_thread::get_id(); }, true);
+    tasks::parallel_for(0, 100, 1, [] (int a, int b) {});
+    release = true;
+    ok = fid.get() != std::this_thread::get_id();
+    for(auto& b: blockers) b.wait();
+    println(hlog, "persistent tasks: ", ok ? "OK" : "ERROR");
+    if(!ok) errors++;
+
+    if(errors) exit(1);
+    }
+
+  else if(argis("-test-shmup")) {
+    /* the shmup turns give the same results, bit for bit, as the serial moves without the intent phase */
+    PHASEFROM(3);
+    auto play = [] (int threads, bool intents) {
+      shmup::threads = threads;
+      shmup::use_intents = intents;
+      shmup::parallel_threshold = 1;
+      stop_game();
+      if(!shmup::on) switch_game_mode(rg::shmup);
+      set_geometry(gNormal);
+      set_variation(eVariation::bitruncated);
+      firstland = specialland = laCanvas;
+      shrand(1);
+      start_game();
+      /* not c->monst, since these would be activated in the order of the addresses */
+      celllister cl(cwt.at, 5, 5000, nullptr);
+      for(int i=0; i<isize(cl.lst); i++) if(cl.getdist(cl.lst[i]) >= 2) {
+        auto m = new shmup::monster;
+        m->type = moAsteroid;
+        m->base = cl.lst[i];
+        m->at = Id;
+        m->hitpoints = 4;
+        m->inertia = spin(i) * point2(cgi.scalefactor / 3000., 0);
+        m->store();
+        }
+      cmode = sm::NORMAL;
+      for(int i=0; i<100; i++) {
+        gmatrix.clear();
+        cells_drawn = 0;
+        cells_generated = 0;
+        just_gmatrix = true;
+        compute_graphical_distance();
+        make_actual_view();
+        currentmap->draw_all();
+        just_gmatrix = false;
+        canmove = true;
+        shmup::turn(20);
+        }
+      /* the order of the monsters within a cell depends on the addresses too, so it is ignored */
+      size_t h = tkills();
+      for(cell *c: currentmap->allcells()) {
+        size_t hc = 0;
+        for(auto m: shmup::monstersAt.at(c)) {
+          size_t hm = m->type;
+          for(int i=0; i<MXDIM; i++) for(int j=0; j<MXDIM; j++) hm = hm * 1000003 + std::hash<ld>()(m->at[i][j]);
+          hc += hm;
+          }
+        h = h * 1000003 + hc;
+        }
+      return h;
+      };
+    auto serial = play(1, false);
+    bool ok = play(1, true) == serial && play(4, true) == serial;
+    shmup::use_intents = true;
+    println(hlog, "shmup with intents and threads: ", ok ? "OK" : "ERROR");
+    if(!ok) errors++;
+    if(errors) exit(1);
+    }
+#endif
+
+#if CAP_ANIMATIONS && CAP_SHOT
+  else if(argis("-test-anim-shards")) {
+    /* every shard of the animation set with -animmove etc. sees the same view in each frame as the sequential render */
+    PHASEFROM(3);
+    start_game();
+    shift(); int n = argi();
+    auto run = [] (int k, int q) {
+      anims::shard_id = k; anims::shard_count = q;
+      View = Id; centerover = cwt.at;
+      map<int, transmatrix> views;
+      int frame = 0;
+      int h1 = addHook(anims::hooks_record_anim, 0, [&] (int i, int) { frame = i; });
+      /* nothing is drawn; hooks_take is called once for every frame rendered */
+      int h2 = addHook(shot::hooks_take, 0, [&] { anims::apply(); views[frame] = View; anims::rollback(); });
+      anims::record_animation_of([] {});
+      delHook(anims::hooks_record_anim, h1);
+      delHook(shot::hooks_take, h2);
+      return views;
+      };
+    auto seq = run(0, 1);
+    int bad = 0, total = 0;
+    for(int k=0; k<n; k++) for(auto& p: run(k, n)) {
+      total++;
+      if(!eqmatrix(p.second, seq[p.first], 1e-9)) bad++;
+      }
+    anims::shard_id = 0; anims::shard_count = 1;
+    bool ok = bad == 0 && total == isize(seq);
+    println(hlog, "animation shards: ", total, " frames, ", bad, " differ", ok ? " OK" : " ERROR");
+    if(!ok) errors++;
+    if(errors) exit(1);
+    }
+#endif
+
+#if CAP_IRR
+  else if(argis("-test-irregular")) {
+    /* stopping an irregular tiling frees its cells; the number of cells would grow with every round otherwise */
+    PHASEFROM(3);
+    vector<int> counts;
+    for(int round=0; round<3; round++) {
+      stop_game();
+      set_geometry(gNormal);
+      set_variation(eVariation::pure);
+      irr::cellcount = 150;
+      irr::auto_creator();
+      { celllister cl(cwt.at, 6, 5000, nullptr); }
+      /* only the cells of the base map of the irregular tiling remain */
+      stop_game();
+      counts.push_back(cellcount);
+      }
+    set_variation(eVariation::pure);
+    start_game();
+    bool ok = counts[0] == counts[1] && counts[1] == counts[2];
+    println(hlog, "irregular restarts: ", counts, ok ? " OK" : " ERROR");
+    if(!ok) errors++;
+    if(errors) exit(1);
+    }
+#endif
+
+  else if(argis("-partest")) {
     hyperpoint h = point31(.01, .05, 0);
     if(LDIM == 3) h[2] = .015;
     println(hlog, "h = ", h);
@@ -116,7 +369,7 @@ int readArgs() {
       println(hlog, "min Ph = ", bt::bt_to_minkowski(h));
       println(hlog, "min DPh = ", test_eq(h, bt::minkowski_to_bt(bt::bt_to_minkowski(h))));
       }
-    });
+    }
 
   else return 1;
   return 0;
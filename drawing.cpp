@@ -60,6 +60,9 @@ struct drawqueueitem {
   virtual ~drawqueueitem() = default;
   /** \brief When minimizing OpenGL calls, we need to group items of the same color, etc. together. This value is used as an extra sorting key. */
   virtual color_t outline_group() = 0;
+  /** \brief Drawqueueitems are allocated from size-class pools which are reused between frames, see dqi_allocator. */
+  static void *operator new(size_t s);
+  static void operator delete(void *p, size_t s);
   };
 
 /** \brief Drawqueueitem used to draw polygons. The majority of drawqueueitems fall here. */
@@ -159,6 +162,50 @@ EX color_t poly_outline;
 
 EX vector<unique_ptr<drawqueueitem>> ptds;
 
+/** \brief Memory for drawqueueitems.
+ *
+ *  A dense frame queues 100k+ items, and they are all freed at the end of the frame. Freed items go to
+ *  free lists (one per 16-byte size class), so the next frame reuses them instead of calling malloc.
+ *  New memory is taken from big chunks. Chunks are never returned, so the memory used stays at the peak.
+ */
+struct dqi_allocator {
+  static constexpr int granule = 16;
+  static constexpr int classes = 64;
+  static constexpr size_t chunk_size = 1<<16;
+  void *free_list[classes];
+  char *bump, *bump_end;
+
+  void *allocate(size_t s) {
+    size_t c = (s + granule - 1) / granule;
+    if(c >= classes) return ::operator new(s);
+    if(void *p = free_list[c]) {
+      free_list[c] = *(void**) p;
+      return p;
+      }
+    size_t need = c * granule;
+    if(size_t(bump_end - bump) < need) {
+      bump = (char*) ::operator new(chunk_size);
+      bump_end = bump + chunk_size;
+      }
+    void *p = bump;
+    bump += need;
+    return p;
+    }
+
+  void release(void *p, size_t s) {
+    size_t c = (s + granule - 1) / granule;
+    if(c >= classes) { ::operator delete(p); return; }
+    *(void**) p = free_list[c];
+    free_list[c] = p;
+    }
+  };
+
+static dqi_allocator dqi_alloc;
+
+void *drawqueueitem::operator new(size_t s) { return dqi_alloc.allocate(s); }
+
+void drawqueueitem::operator delete(void *p, size_t s) { dqi_alloc.release(p, s); }
+
 #if CAP_GL
 EX color_t text_color;
 EX int text_shift;
@@ -175,6 +222,7 @@ vector<glvertex> line_vertices;
 
 EX void glflush() {
   DEBBI(DF_GRAPH, ("glflush"));
+  PROFILE_SUM("glflush (ms)");
   #if MINIMIZE_GL_CALLS
   current_display->set_all(0, m_shift);
   if(isize(triangle_vertices)) {
@@ -299,6 +347,9 @@ bool knowgood;
 hyperpoint goodpoint;
 vector<pair<int, hyperpoint>> tofix;
 
+/** the vertices of the polygon drawn by addpoly, after applying the matrix, and their projections */
+vector<hyperpoint> poly_points, poly_screen;
+
 EX bool two_sided_model() {
   #if CAP_VR
   bool in_vr = vrhr::rendering();
@@ -398,7 +449,8 @@ void fixpoint(glvertex& hscr, hyperpoint H) {
     hscr = glhr::makevertex(Hscr[0]*current_display->radius, Hscr[1]*current_display->radius*pconf.stretch, Hscr[2]*current_display->radius); 
   }
 
-void addpoint(const shiftpoint& H) {
+/** Hscr, if given, is the result of applymodel(H) */
+void addpoint(const shiftpoint& H, const hyperpoint *Hscr_known = nullptr) {
   if(true) {
     ld z = current_display->radius;
     // if(pconf.alpha + H[2] <= BEHIND_LIMIT && pmodel == mdDisk) poly_flags |= POLY_BEHIND;
@@ -434,7 +486,8 @@ void addpoint(const shiftpoint& H) {
         }
       }
     hyperpoint Hscr;
-    applymodel(H, Hscr); 
+    if(Hscr_known) Hscr = *Hscr_known;
+    else applymodel(H, Hscr); 
     if(sphere && pmodel == mdSpiral) {
       if(isize(glcoords)) {
         hyperpoint Hscr1;
@@ -468,12 +521,16 @@ void addpoint(const shiftpoint& H) {
 
 void coords_to_poly() {
   polyi = isize(glcoords);
+  /* hoisted out of the loop, so that the compiler can vectorize it */
+  bool stereo = current_display->stereo_active();
+  int xc = current_display->xcenter, yc = current_display->ycenter;
+  glvertex *g = glcoords.data();
   for(int i=0; i<polyi; i++) {
-    if(!current_display->stereo_active()) glcoords[i][2] = 0;
+    if(!stereo) g[i][2] = 0;
 
-    polyx[i]  = current_display->xcenter + glcoords[i][0] - glcoords[i][2]; 
-    polyxr[i] = current_display->xcenter + glcoords[i][0] + glcoords[i][2]; 
-    polyy[i]  = current_display->ycenter + glcoords[i][1];
+    polyx[i]  = xc + g[i][0] - g[i][2]; 
+    polyxr[i] = xc + g[i][0] + g[i][2]; 
+    polyy[i]  = yc + g[i][1];
     }
   }
 
@@ -498,32 +555,33 @@ void addpoly(const shiftmatrix& V, const vector<glvertex> &tab, int ofs, int cnt
     return;
     }
   tofix.clear(); knowgood = false;
+  if(cnt <= 0) return;
+  /* transform and project all the vertices at once; some of the projections may end up unused */
+  poly_points.resize(cnt); poly_screen.resize(cnt);
+  hyperpoint *P = poly_points.data(), *S = poly_screen.data();
+  applymodel_batch(V, &tab[ofs], cnt, P, S);
+  auto at = [&] (int i) { return shiftpoint{P[i], V.shift}; };
   if(in_perspective()) {
     if(poly_flags & POLY_TRIANGLES) {
-      for(int i=ofs; i<ofs+cnt; i+=3) {
-        shiftpoint h0 = V * glhr::gltopoint(tab[i]);
-        shiftpoint h1 = V * glhr::gltopoint(tab[i+1]);
-        shiftpoint h2 = V * glhr::gltopoint(tab[i+2]);
-        if(!behind3(h0) && !behind3(h1) && !behind3(h2)) 
-          addpoint(h0), addpoint(h1), addpoint(h2);
+      for(int i=0; i+2<cnt; i+=3) {
+        if(!behind3(at(i)) && !behind3(at(i+1)) && !behind3(at(i+2))) 
+          addpoint(at(i), S+i), addpoint(at(i+1), S+i+1), addpoint(at(i+2), S+i+2);
         }
       }
     else {
-      for(int i=ofs; i<ofs+cnt; i++) {
-        shiftpoint h = V * glhr::gltopoint(tab[i]);
-        if(!behind3(h)) addpoint(h);
-        }
+      for(int i=0; i<cnt; i++)
+        if(!behind3(at(i))) addpoint(at(i), S+i);
       }
     return;
     }
-  shiftpoint last = V * glhr::gltopoint(tab[ofs]);
+  shiftpoint last = at(0);
   bool last_behind = is_behind(last.h);
-  if(!last_behind) addpoint(last);
+  if(!last_behind) addpoint(last, S);
   hyperpoint enter = C0;
   hyperpoint firstleave;
   int start_behind = last_behind ? 1 : 0;
-  for(int i=ofs+1; i<ofs+cnt; i++) {
-    shiftpoint curr = V*glhr::gltopoint(tab[i]);
+  for(int i=1; i<cnt; i++) {
+    shiftpoint curr = at(i);
     if(is_behind(curr.h) != last_behind) {
       hyperpoint h = be_just_on_view(last.h, curr.h);
       if(start_behind == 1) start_behind = 2, firstleave = h;
@@ -532,7 +590,7 @@ void addpoly(const shiftmatrix& V, const vector<glvertex> &tab, int ofs, int cnt
       addpoint(shiftless(h));
       last_behind = !last_behind;
       }
-    if(!last_behind) addpoint(curr);
+    if(!last_behind) addpoint(curr, S+i);
     last = curr;
     }
   if(start_behind == 2) {
@@ -1681,6 +1739,7 @@ bool broken_projection(dqi_poly& p0) {
   }
 
 void dqi_poly::draw() {
+  PROFILE_SUM("dqi_poly::draw (ms)");
   if(flags & POLY_DEBUG) debug_this();
 
   if(debugflags & DF_VERTEX) {
@@ -2199,27 +2258,18 @@ void dqi_line::draw_back() {
 
 EX void sort_drawqueue() {
   DEBBI(DF_GRAPH, ("sort_drawqueue"));
+  PROFILE("sort_drawqueue");
   
   for(int a=0; a<PMAX; a++) qp[a] = 0;
   
   int siz = isize(ptds);
 
-  #if MINIMIZE_GL_CALLS
-  map<color_t, vector<unique_ptr<drawqueueitem>>> subqueue;
-  for(auto& p: ptds) subqueue[(p->prio == PPR::CIRCLE || p->prio == PPR::OUTCIRCLE) ? 0 : p->outline_group()].push_back(std::move(p));
-  ptds.clear();
-  for(auto& p: subqueue) for(auto& r: p.second) ptds.push_back(std::move(r));
-  subqueue.clear();
-  for(auto& p: ptds) subqueue[(p->prio == PPR::CIRCLE || p->prio == PPR::OUTCIRCLE) ? 0 : p->color].push_back(std::move(p));
-  ptds.clear();
-  for(auto& p: subqueue) for(auto& r: p.second) ptds.push_back(std::move(r));
-  #endif
-    
   for(auto& p: ptds) {
     int pd = p->prio - PPR::ZERO;
     if(pd < 0 || pd >= PMAX) {
       printf("Illegal priority %d\n", pd);
       p->prio = PPR(rand() % int(PPR::MAX));
+      pd = p->prio - PPR::ZERO;
       }
     qp[pd]++;
     }
@@ -2230,11 +2280,46 @@ EX void sort_drawqueue() {
     qp0[a] = qp[a] = total; total += b;
     }
 
+  /* the items are sorted by (prio, color, outline group), and items with equal keys stay in the queue order;
+   * this is done with a LSD radix sort on the keys, and then the items are moved once */
+
+  static vector<array<color_t, 3>> keys;
+  static vector<int> order, order2;
+  keys.resize(siz);
+  for(int i=0; i<siz; i++) {
+    auto& p = ptds[i];
+    keys[i][0] = int(p->prio);
+    #if MINIMIZE_GL_CALLS
+    bool circle = p->prio == PPR::CIRCLE || p->prio == PPR::OUTCIRCLE;
+    keys[i][1] = circle ? 0 : p->color;
+    keys[i][2] = circle ? 0 : p->outline_group();
+    #else
+    keys[i][1] = keys[i][2] = 0;
+    #endif
+    }
+
+  order.resize(siz); order2.resize(siz);
+  for(int i=0; i<siz; i++) order[i] = i;
+
+  int cnt[257];
+  for(int k: {2, 1, 0}) for(int shift=0; shift<32; shift+=8) {
+    for(int a=0; a<257; a++) cnt[a] = 0;
+    for(int i=0; i<siz; i++) cnt[((keys[i][k] >> shift) & 255) + 1]++;
+    bool trivial = false;
+    for(int a=1; a<257; a++) if(cnt[a] == siz) trivial = true;
+    if(trivial) continue;
+    for(int a=1; a<257; a++) cnt[a] += cnt[a-1];
+    for(int i: order) order2[cnt[(keys[i][k] >> shift) & 255]++] = i;
+    swap(order, order2);
+    }
+
   vector<unique_ptr<drawqueueitem>> ptds2;  
   ptds2.resize(siz);
   
-  for(int i = 0; i<siz; i++) ptds2[qp[int(ptds[i]->prio)]++] = std::move(ptds[i]);
+  for(int i = 0; i<siz; i++) ptds2[i] = std::move(ptds[order[i]]);
   swap(ptds, ptds2);
+
+  for(int a=0; a<PMAX; a++) qp[a] = a+1 < PMAX ? qp0[a+1] : siz;
   }
 
 EX void reverse_priority(PPR p) {
@@ -2308,6 +2393,7 @@ EX int hemi_side = 0;
 
 EX void draw_main() {
   DEBBI(DF_GRAPH, ("draw_main"));
+  PROFILE("draw_main");
   
   if(pconf.back_and_front == 1 && vid.consider_shader_projection) {
     dynamicval<int> pa(pconf.back_and_front);
@@ -2428,6 +2514,8 @@ EX void draw_main() {
 EX void drawqueue() {
 
   DEBBI(DF_GRAPH, ("drawqueue"));
+  PROFILE("drawqueue");
+  PROFILE_COUNT("queued items", isize(ptds));
   
   #if CAP_WRL
   if(wrl::in) { wrl::render(); return; }
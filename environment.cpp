@@ -277,6 +277,330 @@ pathdata::pathdata(eMonster m, bool include_allies IS(true)) {
  **/
 EX vector<int> bfs_reachedfrom;
 
+/** reuse the distances computed by earlier bfs() calls when the players are in the same cells.
+ *  This saves the repeated calls between the player moves (waiting, Orb of Speed, shmup ticks). A move
+ *  to another cell still runs the full BFS: the dcal order decides the order of the monster moves, and
+ *  it cannot be updated from the old layers more cheaply than found anew. Not used in 3D, where the
+ *  layers also depend on gmatrix, which is rebuilt on every frame. */
+EX bool bfs_cache = true;
+
+/** debug: compute the distances anew in every bfs() call, and compare them with the cached ones */
+EX bool bfs_crosscheck = false;
+
+/** the number of bfs_layers kept; one for each starting direction of a cell is enough when the player waits, or in the shmup mode */
+EX int bfs_cache_size = 16;
+
+/** the distance part of bfs(): cells in the order in which they were found, and from where.
+ *  The distances depend only on the map structure (and on gmatrix in 3D), so they do not change
+ *  when walls or monsters do -- only when the players move, when cells are removed, or when
+ *  a cell within the range gets a new neighbor (see new_links).
+ */
+struct bfs_layers {
+  vector<cell*> roots;
+  vector<int> root_dirs;
+  int distlimit;
+  vector<cell*> order;
+  vector<int> reachedfrom, dist;
+  /** the index (in order) of the cell this cell was found from, and the step of its loop; -1 for roots */
+  vector<int> parent, step;
+  /** the cells which are not in order, but are neighbors of expanded cells: roots, and cells outside of gmatrix in 3D */
+  vector<cell*> touched;
+  /** the number of cells whose neighbors have been checked */
+  int expanded;
+  int first7;
+  /** the part of new_links already checked */
+  int links_seen;
+  };
+
+vector<bfs_layers> bfs_cached;
+int bfs_cache_next;
+bfs_layers bfs_uncached;
+
+/** both ends of the links between cells made while some layers are cached */
+vector<cell*> new_links;
+
+void note_link(cell *c1, cell *c2) {
+  if(bfs_cached.empty()) return;
+  new_links.push_back(c1);
+  new_links.push_back(c2);
+  }
+
+/** have the cells expanded in L got new neighbors since L was found? Assumes that cpdist is set according to L */
+bool got_new_links(bfs_layers& L) {
+  bool stale = false;
+  for(int i=L.links_seen; i<isize(new_links); i++)
+    if(int(new_links[i]->cpdist) < L.distlimit) stale = true;
+  L.links_seen = isize(new_links);
+  return stale;
+  }
+
+/** forget the part of new_links checked by all the cached layers; if it gets too long, forget the layers which have not checked it */
+void trim_new_links() {
+  bool all_seen = true;
+  for(auto& L: bfs_cached) if(L.links_seen < isize(new_links)) all_seen = false;
+  if(!all_seen && isize(new_links) < (1<<20)) return;
+  for(auto& L: bfs_cached) if(L.links_seen < isize(new_links)) L.distlimit = -1;
+  new_links.clear();
+  for(auto& L: bfs_cached) L.links_seen = 0;
+  }
+
+bool same_layers(const bfs_layers& a, const bfs_layers& b) {
+  return a.order == b.order && a.reachedfrom == b.reachedfrom && a.dist == b.dist && a.parent == b.parent && a.step == b.step &&
+    a.touched == b.touched && a.expanded == b.expanded && a.first7 == b.first7;
+  }
+
+/** find the layers by BFS; assumes that the roots have cpdist 0 and all the other cells have cpdist INFD */
+void find_layers(bfs_layers& L) {
+  L.order = L.roots;
+  L.reachedfrom = L.root_dirs;
+  int n = isize(L.roots);
+  L.dist.assign(n, 0);
+  L.parent.assign(n, -1);
+  L.step.assign(n, -1);
+  L.touched.clear();
+  L.first7 = 0;
+
+  int qb = 0;
+  L.expanded = 0;
+  while(true) {
+    if(qb == isize(L.order)) break;
+    int i, fd = L.reachedfrom[qb] + L.order[qb]->type/2;
+    cell *c = L.order[qb++];
+
+    int d = c->cpdist;
+
+    if(WDIM == 2 && d == L.distlimit) { L.first7 = qb; break; }
+    L.expanded = qb;
+
+    for(int j=0; j<c->type; j++) if(i = (fd+j) % c->type, c->move(i)) {
+      cell *c2 = c->move(i);
+      if(signed(c2->cpdist) > d+1) {
+        if(WDIM == 3 && !gmatrix.count(c2)) {
+          if(!L.first7) L.first7 = qb;
+          L.touched.push_back(c2);
+          continue;
+          }
+        c2->cpdist = d+1;
+        L.order.push_back(c2);
+        L.reachedfrom.push_back(c->c.spin(i));
+        L.dist.push_back(d+1);
+        L.parent.push_back(qb-1);
+        L.step.push_back(j);
+        }
+      else if(c2->cpdist == 0) L.touched.push_back(c2);
+      }
+    }
+  }
+
+/** the layers for the given roots, from the cache if possible; also sets cpdist */
+bfs_layers& get_layers(const vector<cell*>& roots, const vector<int>& root_dirs, int distlimit) {
+  bool can_cache = bfs_cache && WDIM == 2;
+  bfs_layers *found = nullptr;
+  if(can_cache) for(auto& L: bfs_cached)
+    if(L.distlimit == distlimit && L.roots == roots && L.root_dirs == root_dirs) found = &L;
+
+  bfs_layers *target = &bfs_uncached;
+
+  if(found) {
+    auto& L = *found;
+    for(int i=0; i<isize(L.order); i++) L.order[i]->cpdist = L.dist[i];
+    if(got_new_links(L)) {
+      PROFILE_COUNT("bfs cache stale", 1);
+      for(int i=isize(L.roots); i<isize(L.order); i++) L.order[i]->cpdist = INFD;
+      target = found; found = nullptr;
+      }
+    else if(!bfs_crosscheck) {
+      PROFILE_COUNT("bfs cache hits", 1);
+      trim_new_links();
+      return L;
+      }
+    else
+      for(int i=isize(L.roots); i<isize(L.order); i++) L.order[i]->cpdist = INFD;
+    }
+
+  if(can_cache && !found && target == &bfs_uncached) {
+    if(isize(bfs_cached) < bfs_cache_size) bfs_cached.emplace_back(), target = &bfs_cached.back();
+    else target = &bfs_cached[bfs_cache_next++ % isize(bfs_cached)];
+    }
+  auto& L = *target;
+  L.roots = roots;
+  L.root_dirs = root_dirs;
+  L.distlimit = distlimit;
+  L.links_seen = isize(new_links);
+  find_layers(L);
+
+  if(found && !same_layers(*found, L)) {
+    println(hlog, "bfs cache mismatch at ", roots[0], ", dropping the cache");
+    bfs_cached.clear();
+    }
+  if(can_cache) trim_new_links();
+  return L;
+  }
+
+/** per-cell part of bfs(), for every cell found except the roots */
+void bfs_visit(cell *c2, int distlimit) {
+  if(isWarpedType(c2->land)) havewhat |= HF_WARP;
+  if(c2->land == laMirror) havewhat |= HF_MIRROR;
+  
+  // remove treasures
+  if(!peace::on && c2->item && c2->cpdist == distlimit && itemclass(c2->item) == IC_TREASURE &&
+    c2->item != itBabyTortoise && WDIM != 3 &&
+    (items[c2->item] >= (ls::any_chaos()?10:20) + currentLocalTreasure || getGhostcount() >= 2)) {
+      c2->item = itNone;
+      if(c2->land == laMinefield) { c2->landparam &= ~3; }
+      }
+      
+  if(c2->item == itBombEgg && c2->cpdist == distlimit && items[itBombEgg] >= c2->landparam) {
+    c2->item = itNone;
+    c2->landparam |= 2;
+    c2->landparam &= ~1;
+    if(!c2->monst) c2->monst = moBomberbird, c2->stuntime = 0;
+    }
+  
+  if(c2->item == itBarrow && c2->cpdist == distlimit && c2->wall != waBarrowDig) {
+    c2->item = itNone;
+    }
+  
+  if(c2->item == itLotus && c2->cpdist == distlimit && items[itLotus] >= getHauntedDepth(c2)) {
+    c2->item = itNone;
+    }
+  
+  if(c2->item == itMutant2 && timerghost) {
+    bool rotten = true;
+    for(int i=0; i<c2->type; i++)
+      if(c2->move(i) && c2->move(i)->monst == moMutant)
+        rotten = false;
+    if(rotten) c2->item = itNone;
+    }
+  
+  if(c2->item == itDragon && (shmup::on ? shmup::curtime-c2->landparam>300000 : 
+    turncount-c2->landparam > 500))
+    c2->item = itNone;
+
+  if(c2->item == itTrollEgg && c2->cpdist == distlimit && !shmup::on && c2->landparam && turncount-c2->landparam > 650)
+    c2->item = itNone;
+
+  if(c2->item == itWest && c2->cpdist == distlimit && items[itWest] >= c2->landparam + 4)
+    c2->item = itNone;
+
+  if(c2->item == itMutant && c2->cpdist == distlimit && items[itMutant] >= c2->landparam) {
+    c2->item = itNone;
+    }
+
+  if(c2->item == itIvory && c2->cpdist == distlimit && items[itIvory] >= c2->landparam) {
+    c2->item = itNone;
+    }
+  
+  if(c2->item == itAmethyst && c2->cpdist == distlimit && items[itAmethyst] >= -celldistAlt(c2)/5) {
+    c2->item = itNone;
+    }
+  
+  if(!keepLightning) c2->ligon = 0;
+  
+  checkTide(c2);
+          
+  if(c2->wall == waBigStatue && c2->land != laTemple) 
+    statuecount++;
+  
+  if(isAlch(c2->wall) && c2->land == laWet)
+    wetslime++;
+    
+  if(cellHalfvine(c2) && isWarped(c2)) {
+    addMessage(XLAT("%The1 is destroyed!", c2->wall));
+    destroyHalfvine(c2);
+    }
+  
+  if(c2->wall == waCharged) elec::havecharge = true;
+  if(isElectricLand(c2)) elec::haveelec = true;
+  
+  if(c2->land == laWhirlpool) havewhat |= HF_WHIRLPOOL;
+  if(c2->land == laWhirlwind) havewhat |= HF_WHIRLWIND;
+  if(c2->land == laWestWall) havewhat |= HF_WESTWALL;
+  if(c2->land == laPrairie) havewhat |= HF_RIVER;
+  if(c2->land == laClearing) havewhat |= HF_MUTANT;
+
+  if(c2->wall == waRose) havewhat |= HF_ROSE;
+  
+  if((hadwhat & HF_ROSE) && (rosemap[c2] & 3)) havewhat |= HF_ROSE;
+  
+  if(c2->monst) {
+    if(isHaunted(c2->land) && 
+      c2->monst != moGhost && c2->monst != moZombie && c2->monst != moNecromancer)
+      fail_survivalist();
+    if(c2->monst == moHexSnake || c2->monst == moHexSnakeTail) {
+      havewhat |= HF_HEX;
+      if(c2->mondir != NODIR)
+        snaketypes.insert(snake_pair(c2));
+      if(c2->monst == moHexSnake) hexsnakes.push_back(c2);
+      else findWormIvy(c2);
+      }
+    else if(c2->monst == moKrakenT || c2->monst == moKrakenH) {
+      havewhat |= HF_KRAKEN;
+      }
+    else if(c2->monst == moDragonHead || c2->monst == moDragonTail) {
+      havewhat |= HF_DRAGON;
+      }
+    else if(c2->monst == moWitchSpeed) 
+      havewhat |= HF_FAST;
+    else if(c2->monst == moMutant)
+      havewhat |= HF_MUTANT;
+    else if(c2->monst == moJiangshi)
+      jiangshi_on_screen++;
+    else if(c2->monst == moOutlaw)
+      havewhat |= HF_OUTLAW;
+    else if(isGhostMover(c2->monst))
+      ghosts.push_back(c2);
+    else if(isWorm(c2) || isIvy(c2)) findWormIvy(c2);
+    else if(isBug(c2)) {
+      havewhat |= HF_BUG;
+      targets.push_back(c2);
+      }
+    else if(isFriendly(c2)) {
+      if(c2->monst != moMouse && !markEmpathy(itOrbInvis) && !(isWatery(c2) && markEmpathy(itOrbFish)) &&
+        !c2->stuntime) targets.push_back(c2);
+      if(c2->monst == moGolem) golems.push_back(c2);
+      if(c2->monst == moFriendlyGhost) golems.push_back(c2);
+      if(c2->monst == moKnight) golems.push_back(c2);
+      if(c2->monst == moTameBomberbird) golems.push_back(c2);
+      if(c2->monst == moMouse) { golems.push_back(c2); havewhat |= HF_MOUSE; }
+      if(c2->monst == moPrincess || c2->monst == moPrincessArmed) golems.push_back(c2);
+      if(c2->monst == moIllusion) {
+        if(items[itOrbIllusion]) items[itOrbIllusion]--;
+        else c2->monst = moNone;
+        }
+      }
+    else if(c2->monst == moButterfly) {
+      addButterfly(c2);
+      }
+    else if(isAngryBird(c2->monst)) {
+      havewhat |= HF_BIRD;
+      if(c2->monst == moBat) havewhat |= HF_BATS | HF_EAGLES;
+      if(c2->monst == moEagle) havewhat |= HF_EAGLES;
+      }
+    else if(among(c2->monst, moFrog, moVaulter, moPhaser))
+      havewhat |= HF_JUMP;
+    else if(c2->monst == moReptile) havewhat |= HF_REPTILE;
+    else if(isLeader(c2->monst)) havewhat |= HF_LEADER;
+    else if(c2->monst == moEarthElemental) havewhat |= HF_EARTH;
+    else if(c2->monst == moWaterElemental) havewhat |= HF_WATER;
+    else if(c2->monst == moVoidBeast) havewhat |= HF_VOID;
+    else if(c2->monst == moHunterDog) havewhat |= HF_HUNTER;
+    else if(isMagneticPole(c2->monst)) havewhat |= HF_MAGNET;
+    else if(c2->monst == moAltDemon) havewhat |= HF_ALT;
+    else if(c2->monst == moHexDemon) havewhat |= HF_HEXD;
+    else if(among(c2->monst, moAnimatedDie, moAngryDie)) havewhat |= HF_DICE;
+    else if(c2->monst == moMonk) havewhat |= HF_MONK;
+    else if(c2->monst == moShark || c2->monst == moCShark || among(c2->monst, moRusalka, moPike)) havewhat |= HF_SHARK;
+    else if(c2->monst == moAirElemental) 
+      havewhat |= HF_AIR, airmap.push_back(make_pair(c2,0));
+    }
+  // pheromones!
+  if(c2->land == laHive && c2->landparam >= 50 && c2->wall != waWaxWall) 
+    havewhat |= HF_BUG;
+  if(c2->wall == waThumperOn)
+    targets.push_back(c2);
+  }
+
 /** calculate cpdist, 'have' flags, and do general fixings */
 EX void bfs() {
 
@@ -304,7 +628,9 @@ EX void bfs() {
   airmap.clear();
   if(!(hadwhat & HF_ROSE)) rosemap.clear();
   
-  dcal.clear(); bfs_reachedfrom.clear();
+  static vector<cell*> roots;
+  static vector<int> root_dirs;
+  roots.clear(); root_dirs.clear();
 
   recalcTide = false;
   
@@ -312,8 +638,8 @@ EX void bfs() {
     if(c->cpdist == 0) continue;
     c->cpdist = 0;
     checkTide(c);
-    dcal.push_back(c);
-    bfs_reachedfrom.push_back(hrand(c->type));
+    roots.push_back(c);
+    root_dirs.push_back(hrand(c->type));
     if(!invismove) targets.push_back(c);
     }
   
@@ -325,198 +651,34 @@ EX void bfs() {
       worms.push_back(c);
     }
   
-  int qb = 0;
-  first7 = 0;
-  while(true) {
-    if(qb == isize(dcal)) break;
-    int i, fd = bfs_reachedfrom[qb] + dcal[qb]->type/2;
-    cell *c = dcal[qb++];
-    
-    int d = c->cpdist;
-    
-    if(WDIM == 2 && d == distlimit) { first7 = qb; break; }
-
-    for(int j=0; j<c->type; j++) if(i = (fd+j) % c->type, c->move(i)) {
-      // printf("i=%d cd=%d\n", i, c->move(i)->cpdist);
-      cell *c2 = c->move(i);
-      if(!c2) continue;
-      
-      if(isWarpedType(c2->land)) havewhat |= HF_WARP;
-      if(c2->land == laMirror) havewhat |= HF_MIRROR;
-      
-      if((c->wall == waBoat || c->wall == waSea) &&
-        (c2->wall == waSulphur || c2->wall == waSulphurC))
-        c2->wall = waSea;
-      
-      if(c2 && signed(c2->cpdist) > d+1) {
-        if(WDIM == 3 && !gmatrix.count(c2)) {
-          if(!first7) first7 = qb;
-          continue;
-          }
-        c2->cpdist = d+1;
-        
-        // remove treasures
-        if(!peace::on && c2->item && c2->cpdist == distlimit && itemclass(c2->item) == IC_TREASURE &&
-          c2->item != itBabyTortoise && WDIM != 3 &&
-          (items[c2->item] >= (ls::any_chaos()?10:20) + currentLocalTreasure || getGhostcount() >= 2)) {
-            c2->item = itNone;
-            if(c2->land == laMinefield) { c2->landparam &= ~3; }
-            }
-            
-        if(c2->item == itBombEgg && c2->cpdist == distlimit && items[itBombEgg] >= c2->landparam) {
-          c2->item = itNone;
-          c2->landparam |= 2;
-          c2->landparam &= ~1;
-          if(!c2->monst) c2->monst = moBomberbird, c2->stuntime = 0;
-          }
-        
-        if(c2->item == itBarrow && c2->cpdist == distlimit && c2->wall != waBarrowDig) {
-          c2->item = itNone;
-          }
-        
-        if(c2->item == itLotus && c2->cpdist == distlimit && items[itLotus] >= getHauntedDepth(c2)) {
-          c2->item = itNone;
-          }
-        
-        if(c2->item == itMutant2 && timerghost) {
-          bool rotten = true;
-          for(int i=0; i<c2->type; i++)
-            if(c2->move(i) && c2->move(i)->monst == moMutant)
-              rotten = false;
-          if(rotten) c2->item = itNone;
-          }
-        
-        if(c2->item == itDragon && (shmup::on ? shmup::curtime-c2->landparam>300000 : 
-          turncount-c2->landparam > 500))
-          c2->item = itNone;
-      
-        if(c2->item == itTrollEgg && c2->cpdist == distlimit && !shmup::on && c2->landparam && turncount-c2->landparam > 650)
-          c2->item = itNone;
-
-        if(c2->item == itWest && c2->cpdist == distlimit && items[itWest] >= c2->landparam + 4)
-          c2->item = itNone;
-      
-        if(c2->item == itMutant && c2->cpdist == distlimit && items[itMutant] >= c2->landparam) {
-          c2->item = itNone;
-          }
-      
-        if(c2->item == itIvory && c2->cpdist == distlimit && items[itIvory] >= c2->landparam) {
-          c2->item = itNone;
-          }
-        
-        if(c2->item == itAmethyst && c2->cpdist == distlimit && items[itAmethyst] >= -celldistAlt(c2)/5) {
-          c2->item = itNone;
-          }
-        
-        if(!keepLightning) c2->ligon = 0;
-        dcal.push_back(c2);
-        bfs_reachedfrom.push_back(c->c.spin(i));
-        
-        checkTide(c2);
-                
-        if(c2->wall == waBigStatue && c2->land != laTemple) 
-          statuecount++;
-        
-        if(isAlch(c2->wall) && c2->land == laWet)
-          wetslime++;
-          
-        if(cellHalfvine(c2) && isWarped(c2)) {
-          addMessage(XLAT("%The1 is destroyed!", c2->wall));
-          destroyHalfvine(c2);
-          }
-        
-        if(c2->wall == waCharged) elec::havecharge = true;
-        if(isElectricLand(c2)) elec::haveelec = true;
-        
-        if(c2->land == laWhirlpool) havewhat |= HF_WHIRLPOOL;
-        if(c2->land == laWhirlwind) havewhat |= HF_WHIRLWIND;
-        if(c2->land == laWestWall) havewhat |= HF_WESTWALL;
-        if(c2->land == laPrairie) havewhat |= HF_RIVER;
-        if(c2->land == laClearing) havewhat |= HF_MUTANT;
-
-        if(c2->wall == waRose) havewhat |= HF_ROSE;
-        
-        if((hadwhat & HF_ROSE) && (rosemap[c2] & 3)) havewhat |= HF_ROSE;
-        
-        if(c2->monst) {
-          if(isHaunted(c2->land) && 
-            c2->monst != moGhost && c2->monst != moZombie && c2->monst != moNecromancer)
-            fail_survivalist();
-          if(c2->monst == moHexSnake || c2->monst == moHexSnakeTail) {
-            havewhat |= HF_HEX;
-            if(c2->mondir != NODIR)
-              snaketypes.insert(snake_pair(c2));
-            if(c2->monst == moHexSnake) hexsnakes.push_back(c2);
-            else findWormIvy(c2);
-            }
-          else if(c2->monst == moKrakenT || c2->monst == moKrakenH) {
-            havewhat |= HF_KRAKEN;
-            }
-          else if(c2->monst == moDragonHead || c2->monst == moDragonTail) {
-            havewhat |= HF_DRAGON;
-            }
-          else if(c2->monst == moWitchSpeed) 
-            havewhat |= HF_FAST;
-          else if(c2->monst == moMutant)
-            havewhat |= HF_MUTANT;
-          else if(c2->monst == moJiangshi)
-            jiangshi_on_screen++;
-          else if(c2->monst == moOutlaw)
-            havewhat |= HF_OUTLAW;
-          else if(isGhostMover(c2->monst))
-            ghosts.push_back(c2);
-          else if(isWorm(c2) || isIvy(c2)) findWormIvy(c2);
-          else if(isBug(c2)) {
-            havewhat |= HF_BUG;
-            targets.push_back(c2);
-            }
-          else if(isFriendly(c2)) {
-            if(c2->monst != moMouse && !markEmpathy(itOrbInvis) && !(isWatery(c2) && markEmpathy(itOrbFish)) &&
-              !c2->stuntime) targets.push_back(c2);
-            if(c2->monst == moGolem) golems.push_back(c2);
-            if(c2->monst == moFriendlyGhost) golems.push_back(c2);
-            if(c2->monst == moKnight) golems.push_back(c2);
-            if(c2->monst == moTameBomberbird) golems.push_back(c2);
-            if(c2->monst == moMouse) { golems.push_back(c2); havewhat |= HF_MOUSE; }
-            if(c2->monst == moPrincess || c2->monst == moPrincessArmed) golems.push_back(c2);
-            if(c2->monst == moIllusion) {
-              if(items[itOrbIllusion]) items[itOrbIllusion]--;
-              else c2->monst = moNone;
-              }
-            }
-          else if(c2->monst == moButterfly) {
-            addButterfly(c2);
-            }
-          else if(isAngryBird(c2->monst)) {
-            havewhat |= HF_BIRD;
-            if(c2->monst == moBat) havewhat |= HF_BATS | HF_EAGLES;
-            if(c2->monst == moEagle) havewhat |= HF_EAGLES;
-            }
-          else if(among(c2->monst, moFrog, moVaulter, moPhaser))
-            havewhat |= HF_JUMP;
-          else if(c2->monst == moReptile) havewhat |= HF_REPTILE;
-          else if(isLeader(c2->monst)) havewhat |= HF_LEADER;
-          else if(c2->monst == moEarthElemental) havewhat |= HF_EARTH;
-          else if(c2->monst == moWaterElemental) havewhat |= HF_WATER;
-          else if(c2->monst == moVoidBeast) havewhat |= HF_VOID;
-          else if(c2->monst == moHunterDog) havewhat |= HF_HUNTER;
-          else if(isMagneticPole(c2->monst)) havewhat |= HF_MAGNET;
-          else if(c2->monst == moAltDemon) havewhat |= HF_ALT;
-          else if(c2->monst == moHexDemon) havewhat |= HF_HEXD;
-          else if(among(c2->monst, moAnimatedDie, moAngryDie)) havewhat |= HF_DICE;
-          else if(c2->monst == moMonk) havewhat |= HF_MONK;
-          else if(c2->monst == moShark || c2->monst == moCShark || among(c2->monst, moRusalka, moPike)) havewhat |= HF_SHARK;
-          else if(c2->monst == moAirElemental) 
-            havewhat |= HF_AIR, airmap.push_back(make_pair(c2,0));
-          }
-        // pheromones!
-        if(c2->land == laHive && c2->landparam >= 50 && c2->wall != waWaxWall) 
-          havewhat |= HF_BUG;
-        if(c2->wall == waThumperOn)
-          targets.push_back(c2);
+  auto& L = get_layers(roots, root_dirs, distlimit);
+  dcal = L.order;
+  bfs_reachedfrom = L.reachedfrom;
+  first7 = L.first7;
+
+  for(cell *c2: L.touched) {
+    if(isWarpedType(c2->land)) havewhat |= HF_WARP;
+    if(c2->land == laMirror) havewhat |= HF_MIRROR;
+    }
 
+  /* visit the cells in the order they were found; sulphur next to water is only checked around water */
+  int n = isize(L.order);
+  int next = isize(L.roots);
+  for(int p=0; p<L.expanded; p++) {
+    cell *c = L.order[p];
+    if(c->wall == waBoat || c->wall == waSea) {
+      int i, fd = L.reachedfrom[p] + c->type/2;
+      for(int j=0; j<c->type; j++) if(i = (fd+j) % c->type, c->move(i)) {
+        cell *c2 = c->move(i);
+        if((c->wall == waBoat || c->wall == waSea) &&
+          (c2->wall == waSulphur || c2->wall == waSulphurC))
+          c2->wall = waSea;
+        if(next < n && L.parent[next] == p && L.step[next] == j)
+          bfs_visit(L.order[next++], distlimit);
         }
       }
+    else while(next < n && L.parent[next] == p)
+      bfs_visit(L.order[next++], distlimit);
     }
 
   for(int i=first7; i<isize(dcal); i++)
@@ -535,6 +697,10 @@ EX void bfs() {
   buildAirmap();
   }
 
+auto bfs_hooks =
+  addHook(hooks_clearmemory, 0, [] { bfs_cached.clear(); new_links.clear(); }) +
+  addHook(hooks_removecells, 0, [] { bfs_cached.clear(); new_links.clear(); });
+
 EX void moverefresh(bool turn IS(true)) {
   int dcs = isize(dcal);
   
@@ -809,6 +975,7 @@ EX void findWormIvy(cell *c) {
   }
   
 EX void monstersTurn() {
+  trim_adj_memo();
   reset_spill();
   checkSwitch();
   mirror::breakAll();
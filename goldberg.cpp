@@ -246,6 +246,7 @@ EX namespace gp {
       else {
         peek(wcw) = newCell(SG6, wc.cw.at->master);
         wcw.at->c.setspin(wcw.spin, 0, false);
+        note_link(wcw.at, peek(wcw));
         set_localwalk(wc1, dir1, wcw + wstep);
         if(do_adjm) wc1.adjm = wc.adjm;
         spawn++;
@@ -266,6 +267,7 @@ EX namespace gp {
       DEBB(DF_GP, ("ok"));
       peek(wcw) = wcw1.at;
       wcw.at->c.setspin(wcw.spin, wcw1.spin, wcw.mirrored != wcw1.mirrored);
+      note_link(wcw.at, wcw1.at);
       if(wcw+wstep != wcw1) {
         DEBB(DF_GP | DF_ERROR, ("assertion failed"));
         exit(1);
@@ -4964,6 +4964,7 @@ EX void drawthemap() {
   cgi.require_shapes();
 
   DEBBI(DF_GRAPH, ("draw the map"));
+  PROFILE("drawthemap");
   
   last_firelimit = firelimit;
   firelimit = 0;
@@ -5056,7 +5057,9 @@ EX void drawthemap() {
   arrowtraps.clear();
 
   make_actual_view();
-  currentmap->draw_all();
+  { PROFILE("traversal"); currentmap->draw_all(); }
+  PROFILE_COUNT("cells drawn", cells_drawn);
+  PROFILE_COUNT("cells generated in range", cells_generated);
   drawWormSegments();
   drawBlizzards();
   drawArrowTraps();
@@ -5263,6 +5266,7 @@ EX void drawfullmap() {
     
   check_cgi();
   cgi.require_shapes();
+  trim_adj_memo();
 
   ptds.clear();
 
@@ -5523,6 +5527,9 @@ EX color_t titlecolor;
 EX void drawscreen() {
 
   DEBBI(DF_GRAPH, ("drawscreen"));
+  #if CAP_PROFILING
+  profiler::next_frame();
+  #endif
   #if CAP_GL
   GLWRAP;
   #endif
@@ -29,6 +29,8 @@
 #include "raycaster.cpp"
 #include "hprint.cpp"
 #include "util.cpp"
+#include "profiler.cpp"
+#include "tasks.cpp"
 #include "hyperpoint.cpp"
 #include "patterns.cpp"
 #include "fieldpattern.cpp"
@@ -525,6 +525,10 @@ public:
         map_->erase(prio);
         }
 
+    int size() const {
+        return map_ ? int(map_->size()) : 0;
+    }
+
     template<class... U>
     void callhooks(U&&... args) const {
         if (map_ == nullptr) return;
@@ -1071,6 +1071,52 @@ EX transmatrix inverse(const transmatrix& T) {
     }
   }
 
+/* the kernels for apply_batch, chosen by the type of ld; they compute the same sums as operator *, in the same order */
+template<class T> struct batch_kernel {
+  static void apply(const transmatrix& M, const glvertex *src, hyperpoint *dst, int cnt) {
+    int dim = MXDIM;
+    for(int k=0; k<cnt; k++) {
+      hyperpoint h = glhr::gltopoint(src[k]);
+      for(int i=0; i<dim; i++) {
+        dst[k][i] = 0;
+        for(int j=0; j<dim; j++) dst[k][i] += M[i][j] * h[j];
+        }
+      }
+    }
+  };
+
+#if CAP_SIMD && MAXMDIM == 4
+/* two rows at a time, in SSE2 registers; in the 3-dimensional case, the last coordinate is set to 0 */
+template<> struct batch_kernel<double> {
+  static void apply(const transmatrix& M, const glvertex *src, hyperpoint *dst, int cnt) {
+    int dim = MXDIM;
+    __m128d lo[4], hi[4];
+    for(int j=0; j<dim; j++) {
+      lo[j] = _mm_set_pd(M[1][j], M[0][j]);
+      hi[j] = _mm_set_pd(dim == 4 ? M[3][j] : 0, M[2][j]);
+      }
+    for(int k=0; k<cnt; k++) {
+      const GLfloat *s = &src[k][0];
+      __m128d h = _mm_set1_pd(s[0]);
+      __m128d rlo = _mm_mul_pd(lo[0], h);
+      __m128d rhi = _mm_mul_pd(hi[0], h);
+      for(int j=1; j<dim; j++) {
+        h = _mm_set1_pd(s[j]);
+        rlo = _mm_add_pd(rlo, _mm_mul_pd(lo[j], h));
+        rhi = _mm_add_pd(rhi, _mm_mul_pd(hi[j], h));
+        }
+      _mm_storeu_pd(&dst[k][0], rlo);
+      _mm_storeu_pd(&dst[k][2], rhi);
+      }
+    }
+  };
+#endif
+
+/** \brief dst[k] = M * glhr::gltopoint(src[k]) for k < cnt, i.e., apply M to many vertices at once */
+EX void apply_batch(const transmatrix& M, const glvertex *src, hyperpoint *dst, int cnt) {
+  batch_kernel<ld>::apply(M, src, dst, cnt);
+  }
+
 /** \brief inverse of an orthogonal matrix, i.e., transposition */
 EX transmatrix ortho_inverse(transmatrix T) {
   for(int i=1; i<MDIM; i++)
@@ -1540,6 +1586,153 @@ EX ld geo_dist_q(const hyperpoint h1, const hyperpoint h2, flagtype prec IS(pNOR
   return d;
   }
 
+#if HDR
+/** \brief the basic functions for a fixed isotropic geometry class C, with D homogeneous coordinates
+ *
+ *  These compute the same results as the global functions of the same names, without checking the
+ *  current geometry on every call. Used via dispatch_geometry, which checks the geometry once for a whole loop.
+ *  Elliptic and affine geometries are not covered (they use generic_policy).
+ */
+template<eGeometryClass C, int D> struct iso_policy {
+  static constexpr int L = D-1;
+  /** sig(L), which is also the curvature */
+  static constexpr int last_sig = C == gcHyperbolic ? -1 : C == gcSphere ? 1 : 0;
+
+  static ld sin_auto(ld x) { return C == gcHyperbolic ? sinh(x) : C == gcSphere ? sin(x) : x; }
+  static ld cos_auto(ld x) { return C == gcHyperbolic ? cosh(x) : C == gcSphere ? cos(x) : 1; }
+  static ld acos_auto_clamp(ld x) { return C == gcHyperbolic ? (x < 1 ? 0 : acosh(x)) : C == gcSphere ? acos_clamp(x) : x; }
+
+  static ld intval(const hyperpoint& h1, const hyperpoint& h2) {
+    ld res = 0;
+    for(int i=0; i<L; i++) res += squar(h1[i] - h2[i]);
+    res += squar(h1[L] - h2[L]) * last_sig;
+    return res;
+    }
+
+  static ld zlevel(const hyperpoint& h) {
+    if(C == gcEuclid) return h[L];
+    if(C == gcSphere) return sqrt(intval(h, Hypc));
+    return (h[L] < 0 ? -1 : 1) * sqrt(-intval(h, Hypc));
+    }
+
+  static hyperpoint normalize(hyperpoint H) {
+    ld Z = zlevel(H);
+    for(int c=0; c<D; c++) H[c] /= Z;
+    return H;
+    }
+
+  static ld hdist0(const hyperpoint& mh) {
+    if(C == gcHyperbolic) return mh[L] < 1 ? 0 : acosh(mh[L]);
+    if(C == gcSphere) return mh[L] >= 1 ? 0 : mh[L] <= -1 ? M_PI : acos(mh[L]);
+    return hypot_d(L, mh);
+    }
+
+  static ld hdist(const hyperpoint& h1, const hyperpoint& h2) {
+    ld iv = intval(h1, h2);
+    if(C == gcSphere) return 2 * asin_clamp(sqrt(iv) / 2);
+    if(iv < 0) return 0;
+    if(C == gcHyperbolic) return 2 * asinh(sqrt(iv) / 2);
+    return sqrt(iv);
+    }
+
+  static ld geo_dist(const hyperpoint& h1, const hyperpoint& h2) { return hdist(h1, h2); }
+  static ld geo_dist_q(const hyperpoint& h1, const hyperpoint& h2) { return hdist(h1, h2); }
+
+  static transmatrix ggpushxto0(const hyperpoint& H, ld co) {
+    transmatrix res = Id;
+    if(C == gcEuclid) {
+      for(int i=0; i<L; i++) res[i][L] = H[i] * co;
+      return res;
+      }
+    if(sqhypot_d(L, H) < 1e-16) return res;
+    ld fac = -last_sig/(H[L]+1);
+    for(int i=0; i<L; i++)
+    for(int j=0; j<L; j++)
+      res[i][j] += H[i] * H[j] * fac;
+    for(int d=0; d<L; d++)
+      res[d][L] = co * H[d],
+      res[L][d] = -last_sig * co * H[d];
+    res[L][L] = H[L];
+    return res;
+    }
+
+  static transmatrix rgpushxto0(const hyperpoint& H) { return ggpushxto0(H, 1); }
+  static transmatrix gpushxto0(const hyperpoint& H) { return ggpushxto0(H, -1); }
+
+  static transmatrix iso_inverse(const transmatrix& T) {
+    if(C == gcEuclid) {
+      transmatrix U = Id;
+      for(int i=0; i<L; i++)
+        for(int j=0; j<L; j++)
+          U[i][j] = T[j][i];
+      hyperpoint h = U * tC0(T);
+      for(int i=0; i<L; i++)
+        U[i][L] = -h[i];
+      return U;
+      }
+    transmatrix U = T;
+    for(int i=1; i<D; i++)
+      for(int j=0; j<i; j++)
+        swap(U[i][j], U[j][i]);
+    if(C == gcHyperbolic)
+      for(int i=0; i<L; i++)
+        U[i][L] = -U[i][L],
+        U[L][i] = -U[L][i];
+    return U;
+    }
+
+  static hyperpoint direct_exp(hyperpoint v) {
+    ld d = hypot_d(L, v);
+    if(d > 0) for(int i=0; i<L; i++) v[i] = v[i] * sin_auto(d) / d;
+    v[L] = cos_auto(d);
+    return v;
+    }
+
+  static hyperpoint inverse_exp(const hyperpoint& h) {
+    ld d = acos_auto_clamp(h[L]);
+    hyperpoint v = Hypc;
+    if(d && sin_auto(d)) for(int i=0; i<L; i++) v[i] = h[i] * d / sin_auto(d);
+    #if MAXMDIM >= 4
+    v[3] = 0;
+    #endif
+    return v;
+    }
+  };
+
+/** \brief the policy which just calls the global functions, for the other geometries */
+struct generic_policy {
+  static ld intval(const hyperpoint& h1, const hyperpoint& h2) { return hr::intval(h1, h2); }
+  static ld zlevel(const hyperpoint& h) { return hr::zlevel(h); }
+  static hyperpoint normalize(const hyperpoint& H) { return hr::normalize(H); }
+  static ld hdist0(const hyperpoint& h) { return hr::hdist0(h); }
+  static ld hdist(const hyperpoint& h1, const hyperpoint& h2) { return hr::hdist(h1, h2); }
+  static ld geo_dist(const hyperpoint& h1, const hyperpoint& h2) { return hr::geo_dist(h1, h2); }
+  static ld geo_dist_q(const hyperpoint& h1, const hyperpoint& h2) { return hr::geo_dist_q(h1, h2); }
+  static transmatrix rgpushxto0(const hyperpoint& H) { return hr::rgpushxto0(H); }
+  static transmatrix gpushxto0(const hyperpoint& H) { return hr::gpushxto0(H); }
+  static transmatrix iso_inverse(const transmatrix& T) { return hr::iso_inverse(T); }
+  static hyperpoint direct_exp(const hyperpoint& v) { return hr::direct_exp(v); }
+  static hyperpoint inverse_exp(const hyperpoint& h) { return hr::inverse_exp(shiftless(h)); }
+  };
+
+/** \brief call f(P()), where P is the policy for the current geometry; f should be a template (or a generic lambda) */
+template<class F> void dispatch_geometry(F&& f) {
+  if(!elliptic && !(cgflags & qAFFINE)) switch(cgclass) {
+    #if MAXMDIM >= 4
+    #define DISPATCH(C) if(MDIM == 4) f(iso_policy<C, 4>()); else f(iso_policy<C, 3>()); return;
+    #else
+    #define DISPATCH(C) f(iso_policy<C, 3>()); return;
+    #endif
+    case gcHyperbolic: DISPATCH(gcHyperbolic)
+    case gcSphere: DISPATCH(gcSphere)
+    case gcEuclid: DISPATCH(gcEuclid)
+    #undef DISPATCH
+    default: break;
+    }
+  f(generic_policy());
+  }
+#endif
+
 EX hyperpoint lp_iapply(const hyperpoint h) {
   return nisot::local_perspective_used() ? inverse(NLP) * h : h;
   }
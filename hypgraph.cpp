@@ -398,6 +398,41 @@ EX void applymodel(shiftpoint H_orig, hyperpoint& ret) {
   apply_other_model(H_orig, ret, pmodel);
   }
 
+/** \brief applymodel(shiftpoint{H[i], shift}, ret[i]) for i < cnt
+ *
+ *  The common models (the disk without camera angle, and the perspective) are computed
+ *  without going through apply_other_model for every point; the results are the same.
+ */
+EX void applymodel_batch(const hyperpoint *H, ld shift, hyperpoint *ret, int cnt) {
+  if(pmodel == mdDisk && !nonisotropic && !prod && !vrhr::rendering() && !pconf.camera_angle) {
+    ld alpha = pconf.alpha;
+    int l = LDIM;
+    bool flat = GDIM == 2;
+    ld eye = vid.xres * current_display->eyewidth() / 2 / current_display->radius;
+    for(int i=0; i<cnt; i++) {
+      ld tz = alpha + H[i][l];
+      if(tz < BEHIND_LIMIT && tz > -BEHIND_LIMIT) tz = BEHIND_LIMIT;
+      ret[i][0] = H[i][0] / tz;
+      ret[i][1] = H[i][1] / tz;
+      ret[i][2] = flat ? eye - vid.ipd / tz / 2 : H[i][2] / tz;
+      if(MAXMDIM == 4) ret[i][3] = 1;
+      }
+    }
+  else if(pmodel == mdPerspective && !prod && !nil) {
+    bool lp = nisot::local_perspective_used();
+    for(int i=0; i<cnt; i++)
+      apply_perspective(lp ? NLP * H[i] : H[i], ret[i]);
+    }
+  else for(int i=0; i<cnt; i++)
+    applymodel(shiftpoint{H[i], shift}, ret[i]);
+  }
+
+/** \brief apply V and then the model to the vertices tab[0..cnt); H gets the points before the model is applied */
+EX void applymodel_batch(const shiftmatrix& V, const glvertex *tab, int cnt, hyperpoint *H, hyperpoint *ret) {
+  apply_batch(V.T, tab, H, cnt);
+  applymodel_batch(H, V.shift, ret, cnt);
+  }
+
 EX void vr_sphere(hyperpoint& ret, hyperpoint& H, eModel md) {
   ret = H;
   int flip = 1;
@@ -1295,18 +1330,22 @@ EX void apply_other_model(shiftpoint H_orig, hyperpoint& ret, eModel md) {
     case mdFormula: {
       dynamicval<eModel> m(pmodel, pconf.basic_model);
       applymodel(H_orig, ret);
-      exp_parser ep;
-      ep.extra_params["z"] = cld(ret[0], ret[1]);
-      ep.extra_params["cx"] = ret[0];
-      ep.extra_params["cy"] = ret[1];
-      ep.extra_params["cz"] = ret[2];
-      ep.extra_params["ux"] = H[0];
-      ep.extra_params["uy"] = H[1];
-      ep.extra_params["uz"] = H[2];
-      ep.s = pconf.formula;
-      cld res;
-      try {
-        res = ep.parse();
+      static exp_program prog;
+      static string prog_formula;
+      static bool prog_valid;
+      if(!prog_valid || prog_formula != pconf.formula) {
+        prog_formula = pconf.formula;
+        prog_valid = true;
+        try {
+          prog = compile_formula(pconf.formula, {"z", "cx", "cy", "cz", "ux", "uy", "uz"});
+          }
+        catch(hr_parse_exception&) {
+          prog = exp_program();
+          }
+        }
+      cld res = 0;
+      if(prog.compiled()) try {
+        res = prog.evaluate({cld(ret[0], ret[1]), ret[0], ret[1], ret[2], H[0], H[1], H[2]});
         }
       catch(hr_parse_exception&) {
         res = 0;
@@ -1792,22 +1831,64 @@ void hrmap::draw_all() {
     draw_at(centerover, cview());
   }
 
+/** \brief reuse of the cells visited by hrmap::draw_at between frames
+ *
+ *  draw_at records the cells it visits, in order, with their matrices and with whether their
+ *  neighbors have been enqueued. If the next call has the same map and center, the recorded
+ *  cells are visited again, with the matrices just multiplied by the change of the view,
+ *  instead of doing the BFS. If a cell now gives a different do_draw result, the BFS continues
+ *  from that cell as usual, so the cells drawn are the same as without the cache.
+ */
+EX namespace visible_cache {
+  EX bool on = true;
+  /** \brief redo the BFS when the view has moved further than this since it was done */
+  EX ld max_drift = 1;
+
+  struct entry {
+    cell *c;
+    /** the matrix, for the view `where` */
+    shiftmatrix V;
+    /** have the neighbors been enqueued */
+    bool expanded;
+    /** the number of cells enqueued after this one has been processed */
+    int qend;
+    };
+
+  vector<entry> entries;
+  bool valid;
+  hrmap *cached_map;
+  cell *cached_center;
+  geometry_information *cached_cgi;
+  int destroyed;
+  transmatrix where_inverse;
+  ld where_shift;
+  /** how far the view has moved since the BFS, counting the moves at the rebases */
+  ld drift;
+
+  EX bool available() {
+    if(!on || confusingGeometry() || sl2) return false;
+    if((mdinf[pmodel].flags & mf::uses_bandshift) || (sphere && pmodel == mdSpiral)) return false;
+    return true;
+    }
+
+  void set_view(const shiftmatrix& where) {
+    where_inverse = inverse(where.T);
+    where_shift = where.shift;
+    }
+
+  EX void invalidate() { valid = false; entries.clear(); }
+
+  auto clear_hook = addHook(hooks_clearmemory, 40, invalidate);
+  EX }
+
 void hrmap::draw_at(cell *at, const shiftmatrix& where) {
   dq::clear_all();
   auto& enq = confusingGeometry() ? dq::enqueue_by_matrix_c : dq::enqueue_c;
-  
-  enq(at, where);
-      
-  while(!dq::drawqueue_c.empty()) {
-    auto& p = dq::drawqueue_c.front();
-    cell *c = p.first;
-    shiftmatrix V = p.second;
-    dq::drawqueue_c.pop();
-    
-    if(!do_draw(c, V)) continue;
-    drawcell(c, V);
-    if(in_wallopt() && isWall3(c) && isize(dq::drawqueue) > 1000) continue;
 
+  using namespace visible_cache;
+  bool record = available();
+
+  auto expand = [&] (cell *c, const shiftmatrix& V) {
     #if MAXMDIM >= 4
     if(reg3::ultra_mirror_in())
       for(auto& T: cgi.ultra_mirrors) 
@@ -1820,6 +1901,65 @@ void hrmap::draw_at(cell *at, const shiftmatrix& where) {
       if(c1 == &out_of_bounds) continue;
       enq(c1, optimized_shift(V * adj(c, i)));
       }
+    };
+
+  /* returns true if the neighbors have been enqueued */
+  auto process = [&] (cell *c, const shiftmatrix& V) {
+    if(!do_draw(c, V)) return false;
+    drawcell(c, V);
+    if(in_wallopt() && isWall3(c) && isize(dq::drawqueue) > 1000) return false;
+    expand(c, V);
+    return true;
+    };
+
+  if(record && valid && cached_map == this && cached_center == at && cached_cgi == &cgi && destroyed == cells_destroyed) {
+    transmatrix M = where.T * where_inverse;
+    ld dshift = where.shift - where_shift;
+    ld moved = hdist0(tC0(M));
+    auto moved_V = [&] (const entry& e) { return shiftmatrix{M * e.V.T, e.V.shift + dshift}; };
+    if(drift + moved <= max_drift) {
+      for(int k=0; k<isize(entries); k++) {
+        auto& e = entries[k];
+        shiftmatrix V = moved_V(e);
+        bool draw = do_draw(e.c, V);
+        if(draw) drawcell(e.c, V);
+        bool expanded = draw && !(in_wallopt() && isWall3(e.c) && isize(dq::drawqueue) > 1000);
+        if(expanded == e.expanded) continue;
+
+        /* restore the BFS state after processing the k-th entry, and continue from there */
+        int qend = k ? entries[k-1].qend : 1;
+        for(int i=0; i<qend; i++) {
+          dq::visited_c.insert(entries[i].c);
+          entries[i].V = moved_V(entries[i]);
+          if(i > k) dq::drawqueue_c.emplace(entries[i].c, entries[i].V);
+          }
+        entries.resize(k+1);
+        if(expanded) expand(e.c, e.V);
+        e.expanded = expanded;
+        e.qend = isize(dq::visited_c);
+        drift += moved;
+        set_view(where);
+        goto bfs;
+        }
+      return;
+      }
+    }
+
+  entries.clear();
+  valid = record;
+  cached_map = this; cached_center = at; cached_cgi = &cgi; destroyed = cells_destroyed;
+  drift = 0;
+  if(record) set_view(where);
+  enq(at, where);
+
+  bfs:
+  while(!dq::drawqueue_c.empty()) {
+    auto& p = dq::drawqueue_c.front();
+    cell *c = p.first;
+    shiftmatrix V = p.second;
+    dq::drawqueue_c.pop();
+    bool expanded = process(c, V);
+    if(record) entries.push_back(entry{c, V, expanded, isize(dq::visited_c)});
     }
   }
 
@@ -2817,51 +2957,147 @@ EX shiftmatrix optimized_shift(const shiftmatrix& T) {
   }
 
 EX namespace dq {
-  EX queue<pair<heptagon*, shiftmatrix>> drawqueue;
+
+  #if HDR
+  inline unsigned long long visited_hash(unsigned x) { return x; }
+  inline unsigned long long visited_hash(const void *p) { return (unsigned long long) (size_t) p; }
+
+  /** \brief a set of pointers or buckets, for a single traversal
+   *
+   *  Open addressing with linear probing. The table is kept between traversals: clear() just
+   *  increases the generation, and the entries from the older generations count as empty.
+   */
+  template<class K> struct visited_table {
+    struct entry { K key; unsigned gen; };
+    vector<entry> table;
+    unsigned gen;
+    int qty, bits;
+    /** the number of lookups and probes since the last clear, for profiling */
+    int lookups, probes;
+
+    visited_table() : gen(1), qty(0), bits(0), lookups(0), probes(0) {}
+
+    int index(K k) const { return bits ? int((visited_hash(k) * 0x9E3779B97F4A7C15ull) >> (64 - bits)) : 0; }
+
+    /** the position of k in the table, or the empty position where it would be */
+    int find(K k) {
+      int mask = isize(table) - 1;
+      int i = index(k);
+      lookups++; probes++;
+      while(table[i].gen == gen && table[i].key != k) i = (i+1) & mask, probes++;
+      return i;
+      }
+
+    void rehash(int nbits) {
+      vector<entry> old;
+      swap(old, table);
+      bits = nbits;
+      table.resize(1 << bits, entry{K(), 0});
+      for(auto& e: old) if(e.gen == gen) {
+        int mask = isize(table) - 1;
+        int i = index(e.key);
+        while(table[i].gen == gen) i = (i+1) & mask;
+        table[i] = e;
+        }
+      }
+
+    int count(K k) {
+      if(!qty) return 0;
+      return table[find(k)].gen == gen;
+      }
+
+    /** returns true if k was not in the set yet */
+    bool insert(K k) {
+      if(2 * (qty+1) > isize(table)) rehash(max(bits + 1, 8));
+      auto& e = table[find(k)];
+      if(e.gen == gen) return false;
+      e.key = k; e.gen = gen; qty++;
+      return true;
+      }
+
+    void clear() {
+      qty = 0; lookups = 0; probes = 0;
+      if(!++gen) {
+        for(auto& e: table) e.gen = 0;
+        gen = 1;
+        }
+      }
+
+    int size() const { return qty; }
+    };
+
+  /** \brief a FIFO queue in a ring buffer, which keeps its capacity after clear()
+   *
+   *  Like in a vector, emplace may invalidate the references to the elements.
+   */
+  template<class T> struct ring_queue {
+    vector<T> data;
+    int head, qty;
+
+    ring_queue() : head(0), qty(0) {}
+
+    bool empty() const { return !qty; }
+    int size() const { return qty; }
+    T& front() { return data[head]; }
+    void pop() { head = (head+1) & (isize(data)-1); qty--; }
+    void clear() { head = 0; qty = 0; }
+
+    template<class... U> void emplace(U&&... u) {
+      if(qty == isize(data)) {
+        vector<T> ndata(max(2 * qty, 64));
+        for(int i=0; i<qty; i++) ndata[i] = std::move(data[(head+i) & (qty-1)]);
+        swap(data, ndata);
+        head = 0;
+        }
+      data[(head+qty) & (isize(data)-1)] = T(std::forward<U>(u)...);
+      qty++;
+      }
+    };
+  #endif
+
+  EX ring_queue<pair<heptagon*, shiftmatrix>> drawqueue;
   
   EX unsigned bucketer(const shiftpoint& T) {
     return bucketer(T.h) + unsigned(floor(T.shift*81527+.5));
     }
 
-  EX set<heptagon*> visited;
+  EX visited_table<heptagon*> visited;
   EX void enqueue(heptagon *h, const shiftmatrix& T) {
-    if(!h || visited.count(h)) { return; }
-    visited.insert(h);
+    if(!h || !visited.insert(h)) { return; }
     drawqueue.emplace(h, T);
     }  
 
-  EX set<unsigned> visited_by_matrix;
+  EX visited_table<unsigned> visited_by_matrix;
   EX void enqueue_by_matrix(heptagon *h, const shiftmatrix& T) {
     if(!h) return;
     unsigned b = bucketer(tC0(T));
-    if(visited_by_matrix.count(b)) { return; }
-    visited_by_matrix.insert(b);
+    if(!visited_by_matrix.insert(b)) { return; }
     drawqueue.emplace(h, T);
     }
 
-  EX queue<pair<cell*, shiftmatrix>> drawqueue_c;
-  EX set<cell*> visited_c;
+  EX ring_queue<pair<cell*, shiftmatrix>> drawqueue_c;
+  EX visited_table<cell*> visited_c;
 
   EX void enqueue_c(cell *c, const shiftmatrix& T) {
-    if(!c || visited_c.count(c)) { return; }
-    visited_c.insert(c);
+    if(!c || !visited_c.insert(c)) { return; }
     drawqueue_c.emplace(c, T);
     }
 
   EX void enqueue_by_matrix_c(cell *c, const shiftmatrix& T) {
     if(!c) return;
     unsigned b = bucketer(tC0(T));
-    if(visited_by_matrix.count(b)) { return; }
-    visited_by_matrix.insert(b);
+    if(!visited_by_matrix.insert(b)) { return; }
     drawqueue_c.emplace(c, T);
     }
   
   EX void clear_all() {
+    PROFILE_COUNT("dq lookups", visited.lookups + visited_by_matrix.lookups + visited_c.lookups);
+    PROFILE_COUNT("dq probes", visited.probes + visited_by_matrix.probes + visited_c.probes);
     visited.clear();
     visited_by_matrix.clear();
     visited_c.clear();
-    while(!drawqueue_c.empty()) drawqueue_c.pop();
-    while(!drawqueue.empty()) drawqueue.pop();
+    drawqueue_c.clear();
+    drawqueue.clear();
     }
 
 
@@ -2891,6 +3127,7 @@ bool limited_generation(cell *c) {
   }
 
 EX bool do_draw(cell *c, const shiftmatrix& T) {
+  PROFILE_COUNT("do_draw tests", 1);
 
   if(WDIM == 3) {
     // do not care about cells outside of the track
@@ -539,7 +539,7 @@ EX void clear_links(heptagon *h) {
   for(cell *c: hi.subcells) {
     for(int i=0; i<c->type; i++) if(c->move(i)) c->move(i)->move(c->c.spin(i)) = NULL;
     cellindex.erase(c);
-    delete c;
+    destroy_cell(c);
     }
   h->c7 = NULL;
   periodmap.erase(h);
@@ -270,6 +270,7 @@ EX void gen_eclectic_monster(cell *c) {
   }
 
 EX void giantLandSwitch(cell *c, int d, cell *from) {
+  PROFILE_SUM("giantLandSwitch (ms)");
   bool fargen = d == min(BARLEV, 9);
   switch(c->land) {
 
@@ -2848,6 +2849,8 @@ EX hookset<bool(cell *c, int d, cell *from)> hooks_cellgen;
 EX void setdist(cell *c, int d, cell *from) {
 
   if(c == &out_of_bounds) return;
+  PROFILE_SUM("setdist (ms)");
+  PROFILE_COUNT("setdist calls", 1);
   if(fake::in()) return FPIU(setdist(c, d, from));
   
   if(c->mpdist <= d) return;
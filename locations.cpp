@@ -126,6 +126,11 @@ template<class T> struct walker;
 
 int gmod(int i, int j);
 
+struct cell;
+/** \brief called when two cells get connected */
+void note_link(cell *c1, cell *c2);
+template<class T> void note_link(T *c1, T *c2) {}
+
 template<class T> struct connection_table {
 
   /** \brief Table of moves. This is the maximum size, but tailored_alloc allocates less. */
@@ -162,6 +167,7 @@ template<class T> struct connection_table {
     c1->move(d1) = full();
     setspin(d0, d1, m);
     c1->c.setspin(d1, d0, m);    
+    note_link(full(), c1);
     }
   /* like the other connect, but take the parameters of the other cell from a walker */
   void connect(int d0, walker<T> hs) {
@@ -177,11 +183,44 @@ template<class T> struct connection_table {
  * RAM, so we really need to be careful on low memory devices. 
  */
 
+/** \brief The memory for tailored_alloc comes from slabs, with separate slabs for every object size.
+ *
+ *  Objects are taken from the current slab in the order of allocation, so the cells generated
+ *  together are also together in memory. Freed objects are put on a free list, and reused by the
+ *  next allocation of the same size. The slabs of a size are released by slab_release when
+ *  all the objects of that size have been freed. Not thread-safe, just like the map generation.
+ */
+struct slab_class {
+  /** object size in bytes */
+  int size;
+  /** the freed objects; each of them points to the next one */
+  void *free_list;
+  /** the unused part of the last slab */
+  char *next, *end;
+  vector<char*> slabs;
+  /** the number of objects in a slab */
+  int per_slab;
+  /** the number of objects currently allocated */
+  int live;
+  slab_class() : size(0), free_list(nullptr), next(nullptr), end(nullptr), per_slab(0), live(0) {}
+  };
+
+static const int slab_align = 8;
+
+void *slab_alloc(int size);
+void slab_free(void *p, int size);
+
+/** \brief the size of T with `degree` connections, as allocated by tailored_alloc */
+template<class T> int tailored_size(int degree) {
+  int b = offsetof(T, c) + offsetof(connection_table<T>, move_table) + sizeof(T*) * degree + degree;
+  return (b + slab_align - 1) / slab_align * slab_align;
+  }
+
 template<class T> T* tailored_alloc(int degree) {
   T* result;
 #ifndef NO_TAILORED_ALLOC
-  int b = offsetof(T, c) + offsetof(connection_table<T>, move_table) + sizeof(T*) * degree + degree;
-  result = (T*) new char[b];
+  static_assert(alignof(T) <= slab_align, "slab_align too small");
+  result = (T*) slab_alloc(tailored_size<T>(degree));
   new (result) T();
 #else
   result = new T;
@@ -193,8 +232,13 @@ template<class T> T* tailored_alloc(int degree) {
 
 /** \brief Counterpart to hr::tailored_alloc(). */
 template<class T> void tailored_delete(T* x) {
+#ifndef NO_TAILORED_ALLOC
+  int size = tailored_size<T>(x->type);
   x->~T();  
-  delete[] ((char*) (x));
+  slab_free(x, size);
+#else
+  delete x;
+#endif
   }
 
 static const struct wstep_t { wstep_t() {} } wstep;
@@ -500,6 +544,66 @@ struct movei {
   };
 #endif
 
+/** \brief the size of a slab, in bytes (fixed for every size when its first slab is allocated) */
+EX int slab_size = 1<<16;
+
+/** \brief slab_classes()[size / slab_align] is used for objects of the given size; never destroyed, since maps may be freed at exit */
+EX vector<slab_class>& slab_classes() {
+  static vector<slab_class> *classes = new vector<slab_class>;
+  return *classes;
+  }
+
+void *slab_alloc(int size) {
+  auto& classes = slab_classes();
+  int id = size / slab_align;
+  if(id >= isize(classes)) {
+    int old = isize(classes);
+    classes.resize(id+1);
+    for(int i=old; i<=id; i++) classes[i].size = i * slab_align;
+    }
+  auto& sc = classes[id];
+  sc.live++;
+  if(sc.free_list) {
+    void *p = sc.free_list;
+    sc.free_list = *(void**) p;
+    return p;
+    }
+  if(sc.next == sc.end) {
+    if(sc.slabs.empty()) sc.per_slab = max(slab_size / size, 1);
+    char *s = new char[sc.per_slab * size];
+    sc.slabs.push_back(s);
+    sc.next = s; sc.end = s + sc.per_slab * size;
+    }
+  void *p = sc.next;
+  sc.next += size;
+  return p;
+  }
+
+void slab_free(void *p, int size) {
+  auto& sc = slab_classes()[size / slab_align];
+  *(void**) p = sc.free_list;
+  sc.free_list = p;
+  sc.live--;
+  }
+
+/** \brief free the slabs of the sizes which have no objects allocated anymore */
+EX void slab_release() {
+  for(auto& sc: slab_classes()) if(sc.live == 0 && !sc.slabs.empty()) {
+    for(char *s: sc.slabs) delete[] s;
+    sc.slabs.clear();
+    sc.free_list = nullptr;
+    sc.next = sc.end = nullptr;
+    }
+  }
+
+EX void print_slab_stats() {
+  for(auto& sc: slab_classes()) if(!sc.slabs.empty()) {
+    long long used = (isize(sc.slabs) - 1) * 1LL * sc.per_slab + (sc.next - sc.slabs.back()) / sc.size;
+    println(hlog, "size ", sc.size, ": ", sc.live, " objects, ", isize(sc.slabs), " slabs of ", sc.per_slab,
+      ", ", format("%.1f%%", sc.live * 100. / used), " of the used slots occupied");
+    }
+  }
+
 EX movei moveimon(cell *c) { return movei(c, c->mondir); }
 
 EX movei match(cell *f, cell *t) {
@@ -63,39 +63,143 @@ EX namespace sn {
   inline hyperpoint decompress(compressed_point p) { return point3(p[0], p[1], p[2]); }
   inline compressed_point compress(hyperpoint h) { return make_array<float>(h[0], h[1], h[2]); }
 
+  /** the header of a geodesic table file, followed by PRECX*PRECY*PRECZ compressed_points.
+   *  The older files have no header, just PRECX, PRECY, PRECZ as three ints before the points.
+   */
+  struct table_header {
+    char magic[8];
+    int version;
+    int PRECX, PRECY, PRECZ;
+    /** ginf[].shortname of the geometry */
+    char geometry[16];
+    /** table_checksum of the points */
+    unsigned checksum;
+    int reserved[5];
+    };
+
   struct tabled_inverses {
     int PRECX, PRECY, PRECZ;
+    /** the points, when they are in memory rather than mapped (built tables, or no CAP_MMAP) */
     vector<compressed_point> tab;
+    /** the points; the mapped ones are read-only, see make_writable */
+    compressed_point *data;
     string fname;
     bool loaded;
+    /** the checksum from the header, or 0 for the old format */
+    unsigned checksum;
+    void *mapped;
+    size_t mapped_size;
     
     void load();
+    void make_writable();
+    bool verify();
+    table_header header(bool with_checksum);
     hyperpoint get(ld ix, ld iy, ld iz, bool lazy);
     
-    compressed_point& get_int(int ix, int iy, int iz) { return tab[(iz*PRECY+iy)*PRECX+ix]; }
+    int size() { return PRECX * PRECY * PRECZ; }
+    compressed_point& get_int(int ix, int iy, int iz) { return data[(iz*PRECY+iy)*PRECX+ix]; }
   
     GLuint texture_id;
     bool toload;
     
     GLuint get_texture_id();
   
-    tabled_inverses(string s) : fname(s), texture_id(0), toload(true) {}  
+    tabled_inverses(string s) : data(nullptr), fname(s), loaded(false), checksum(0), mapped(nullptr), mapped_size(0), texture_id(0), toload(true) {}  
     };
   #endif
   
+  static const char table_magic[8] = "HRGEODT";
+  EX int table_version = 1;
+  
+  EX unsigned table_checksum(const compressed_point *p, int qty) {
+    unsigned h = 2166136261u;
+    auto c = (const unsigned char*) p;
+    for(size_t i=0; i<sizeof(compressed_point) * qty; i++) h = (h ^ c[i]) * 16777619u;
+    return h;
+    }
+  
+  table_header tabled_inverses::header(bool with_checksum) {
+    table_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, table_magic, 8);
+    h.version = table_version;
+    h.PRECX = PRECX; h.PRECY = PRECY; h.PRECZ = PRECZ;
+    strncpy(h.geometry, ginf[geom()].shortname, sizeof(h.geometry) - 1);
+    if(with_checksum) h.checksum = table_checksum(data, size());
+    return h;
+    }
+  
+  /** the table is mapped rather than read where possible, so only the parts actually used are paged in;
+   *  the checksum is not verified here, since that would read the whole table (see verify)
+   */
   void tabled_inverses::load() {
     if(loaded) return;
     FILE *f = fopen(fname.c_str(), "rb");
     if(!f) f = fopen((rsrcdir + fname).c_str(), "rb");
     if(!f) { addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return; }
-    hr::ignore(fread(&PRECX, 4, 1, f));
-    hr::ignore(fread(&PRECY, 4, 1, f));
-    hr::ignore(fread(&PRECZ, 4, 1, f));
-    tab.resize(PRECX * PRECY * PRECZ);
-    hr::ignore(fread(&tab[0], sizeof(compressed_point) * PRECX * PRECY * PRECZ, 1, f));
+    table_header h;
+    size_t offset;
+    memset(&h, 0, sizeof(h));
+    hr::ignore(fread(&h, 12, 1, f));
+    if(memcmp(h.magic, table_magic, 8) == 0) {
+      hr::ignore(fread((char*)&h + 12, sizeof(h) - 12, 1, f));
+      if(h.version != table_version || strncmp(h.geometry, ginf[geom()].shortname, sizeof(h.geometry))) {
+        fclose(f);
+        println(hlog, fname, ": table for another geometry or version");
+        addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return;
+        }
+      PRECX = h.PRECX; PRECY = h.PRECY; PRECZ = h.PRECZ;
+      checksum = h.checksum;
+      offset = sizeof(h);
+      }
+    else {
+      int *prec = (int*) &h;
+      PRECX = prec[0]; PRECY = prec[1]; PRECZ = prec[2];
+      checksum = 0;
+      offset = 12;
+      }
+    size_t bytes = sizeof(compressed_point) * size();
+    fseek(f, 0, SEEK_END);
+    if(size_t(ftell(f)) != offset + bytes) {
+      fclose(f);
+      println(hlog, fname, ": wrong file size");
+      addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return;
+      }
+    #if CAP_MMAP
+    void *m = mmap(nullptr, offset + bytes, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if(m != MAP_FAILED) {
+      mapped = m; mapped_size = offset + bytes;
+      data = (compressed_point*) ((char*) m + offset);
+      fclose(f);
+      loaded = true;
+      return;
+      }
+    #endif
+    fseek(f, offset, SEEK_SET);
+    tab.resize(size());
+    hr::ignore(fread(&tab[0], bytes, 1, f));
+    data = &tab[0];
     fclose(f);
     loaded = true;    
     }
+
+  /** copy a mapped table to memory, so that it can be modified */
+  void tabled_inverses::make_writable() {
+    load();
+    if(!mapped) return;
+    tab.assign(data, data + size());
+    data = &tab[0];
+    #if CAP_MMAP
+    munmap(mapped, mapped_size);
+    #endif
+    mapped = nullptr;
+    }
+
+  /** does the table match the checksum from its header? (always true for the old format) */
+  bool tabled_inverses::verify() {
+    load();
+    return loaded && (!checksum || table_checksum(data, size()) == checksum);
+    }
   
   hyperpoint tabled_inverses::get(ld ix, ld iy, ld iz, bool lazy) {
     ix *= PRECX-1;
@@ -156,7 +260,7 @@ EX namespace sn {
     auto xbuffer = new glvertex[PRECZ*PRECY*PRECX];
     
     for(int z=0; z<PRECZ*PRECY*PRECX; z++) {
-      auto& t = tab[z];
+      auto& t = data[z];
       xbuffer[z] = glhr::makevertex(t[0], t[1], t[2]);
       }
     
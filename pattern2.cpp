@@ -1669,82 +1669,108 @@ EX namespace patterns {
     }
   
 
-  cld compute_map_function(cell *c, int p, const string& formula) {
-    exp_parser ep;
-    ep.extra_params["p"] = p;
+  /** \brief call f(name, value) for every variable available in compute_map_function; the list of names depends only on the geometry */
+  template<class T> void map_function_variables(cell *c, int p, const T& f) {
+    f("p", p);
 
     hyperpoint h = calc_relative_matrix(c, currentmap->gamestart(), C0) * C0;
-    ep.extra_params["x"] = h[0];
-    ep.extra_params["y"] = h[1];
-    ep.extra_params["z"] = h[2];
+    f("x", h[0]);
+    f("y", h[1]);
+    f("z", h[2]);
     #if MAXMDIM >= 4
-    ep.extra_params["w"] = h[3];
+    f("w", h[3]);
     #endif
-    ep.extra_params["z40"] = zebra40(c);
-    ep.extra_params["z3"] = zebra3(c);
-    ep.extra_params["ev"] = emeraldval(c);
-    ep.extra_params["fv50"] = fiftyval(c);
-    ep.extra_params["pa"] = polara50(c);
-    ep.extra_params["pb"] = polarb50(c);
-    ep.extra_params["pd"] = cdist50(c);
-    ep.extra_params["fu"] = fieldpattern::fieldval_uniq(c);
-    ep.extra_params["threecolor"] = pattern_threecolor(c);
-    ep.extra_params["chess"] = chessvalue(c);
-    ep.extra_params["ph"] = pseudohept(c);
-    ep.extra_params["kph"] = kraken_pseudohept(c);
+    f("z40", zebra40(c));
+    f("z3", zebra3(c));
+    f("ev", emeraldval(c));
+    f("fv50", fiftyval(c));
+    f("pa", polara50(c));
+    f("pb", polarb50(c));
+    f("pd", cdist50(c));
+    f("fu", fieldpattern::fieldval_uniq(c));
+    f("threecolor", pattern_threecolor(c));
+    f("chess", chessvalue(c));
+    f("ph", pseudohept(c));
+    f("kph", kraken_pseudohept(c));
     if(true) {
-      ep.extra_params["md"] = c->master->distance;
-      ep.extra_params["me"] = c->master->emeraldval;
-      ep.extra_params["mf"] = c->master->fieldval;
-      ep.extra_params["mz"] = c->master->zebraval;
+      f("md", c->master->distance);
+      f("me", c->master->emeraldval);
+      f("mf", c->master->fieldval);
+      f("mz", c->master->zebraval);
       }
 
     if(sphere) {
-      ep.extra_params["h0"] = getHemisphere(c, 0);
-      ep.extra_params["h1"] = getHemisphere(c, 1);
-      ep.extra_params["h2"] = getHemisphere(c, 2);
+      f("h0", getHemisphere(c, 0));
+      f("h1", getHemisphere(c, 1));
+      f("h2", getHemisphere(c, 2));
       }
     if(euclid) {
       auto co = euc2_coordinates(c);
       int x = co.first, y = co.second;
-      ep.extra_params["ex"] = x;
-      ep.extra_params["ey"] = y;
-      if(S7 == 6) ep.extra_params["ez"] = -x-y;
+      f("ex", x);
+      f("ey", y);
+      if(S7 == 6) f("ez", -x-y);
       }
     #if CAP_CRYSTAL
     if(cryst) {
       crystal::ldcoord co = crystal::get_ldcoord(c);
       for(int i=0; i<crystal::MAXDIM; i++)
-        ep.extra_params["x"+its(i)] = co[i];
+        f("x"+its(i), co[i]);
       }
     #endif
     #if CAP_SOLV
     if(asonov::in()) {
       auto co = asonov::get_coord(c->master);
-      ep.extra_params["ax"] = szgmod(co[0], asonov::period_xy);
-      ep.extra_params["ay"] = szgmod(co[1], asonov::period_xy);
-      ep.extra_params["az"] = szgmod(co[2], asonov::period_z);      
+      f("ax", szgmod(co[0], asonov::period_xy));
+      f("ay", szgmod(co[1], asonov::period_xy));
+      f("az", szgmod(co[2], asonov::period_z));      
       }
     #endif
     if(nil) {
       auto co = nilv::get_coord(c->master);
-      ep.extra_params["nx"] = szgmod(co[0], nilv::nilperiod[0]);
-      ep.extra_params["ny"] = szgmod(co[1], nilv::nilperiod[1]);
-      ep.extra_params["nz"] = szgmod(co[2], nilv::nilperiod[2]);      
+      f("nx", szgmod(co[0], nilv::nilperiod[0]));
+      f("ny", szgmod(co[1], nilv::nilperiod[1]));
+      f("nz", szgmod(co[2], nilv::nilperiod[2]));      
       }
     if(hybri)
-      ep.extra_params["level"] = hybrid::get_where(c).second;
+      f("level", hybrid::get_where(c).second);
 
     if(geometry_supports_cdata()) {
-      ep.extra_params["d0"] = getCdata(c, 0);
-      ep.extra_params["d1"] = getCdata(c, 1);
-      ep.extra_params["d2"] = getCdata(c, 2);
-      ep.extra_params["d3"] = getCdata(c, 3);
+      f("d0", getCdata(c, 0));
+      f("d1", getCdata(c, 1));
+      f("d2", getCdata(c, 2));
+      f("d3", getCdata(c, 3));
       }
         
-    ep.s = formula;
+    }
+
+  /** \brief color_formula compiled for the current geometry; invalidated on hooks_clearmemory */
+  exp_program map_function_program;
+  string map_function_formula;
+  bool map_function_valid, map_function_error;
+
+  cld compute_map_function(cell *c, int p, const string& formula) {
+    auto& prog = map_function_program;
+    if(!map_function_valid || formula != map_function_formula) {
+      vector<string> names;
+      map_function_variables(c, p, [&] (const string& name, cld) { names.push_back(name); });
+      map_function_formula = formula;
+      try {
+        prog = compile_formula(formula, names);
+        map_function_error = false;
+        }
+      catch(hr_parse_exception&) {
+        prog = exp_program();
+        map_function_error = true;
+        }
+      map_function_valid = true;
+      }
+    if(map_function_error) return 0;
+    static vector<cld> values;
+    values.clear();
+    map_function_variables(c, p, [] (const string&, cld v) { values.push_back(v); });
     try {
-      return ep.parse();
+      return prog.evaluate(values);
       }
     catch(hr_parse_exception&) {
       return 0;
@@ -3177,7 +3203,7 @@ int read_pattern_args() {
   return 0;
   }
 
-auto ah_pattern = addHook(hooks_args, 0, read_pattern_args) + addHook(hooks_clearmemory, 100, [] { patterns::computed_nearer_map.clear(); patterns::computed_furthest_map.clear(); });
+auto ah_pattern = addHook(hooks_args, 0, read_pattern_args) + addHook(hooks_clearmemory, 100, [] { patterns::computed_nearer_map.clear(); patterns::computed_furthest_map.clear(); patterns::map_function_valid = false; });
 #endif
 
 }
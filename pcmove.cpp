@@ -417,6 +417,28 @@ extern void playSound(cell *c, const string& fname, int vol);
  */
 
 struct changes_t {
+
+  /** \brief What a journal entry restores on rollback. */
+  enum class jtype : char { cell, bytes, closure, pop_push };
+
+  /** \brief An entry of the undo journal.
+   *
+   *  For jtype::cell, index is in cells; for jtype::bytes, the size bytes at ptr are restored
+   *  from position index in bytes; for jtype::closure, rollbacks[index] is called.
+   */
+  struct journal_entry {
+    jtype type;
+    int index, size;
+    void *ptr;
+    };
+
+  /** \brief The undo journal, in the order in which the changes were made. */
+  vector<journal_entry> journal;
+  /** \brief Saved cell metadata. */
+  vector<pair<cell*, gcell>> cells;
+  /** \brief Saved values of trivially copyable objects. */
+  vector<char> bytes;
+  /** \brief Rollbacks which could not be expressed in the other ways. */
   vector<reaction_t> rollbacks;
   vector<reaction_t> commits;
   bool on;
@@ -446,18 +468,38 @@ struct changes_t {
   void commit() { 
     on = false; 
     for(auto& p: commits) p();
-    rollbacks.clear();
-    commits.clear();
+    clear();
     }
 
   /** \brief Rollback the changes. */
 
   void rollback(int pos = 0) { 
     on = false;
-    while(!rollbacks.empty()) {
-      rollbacks.back()();
-      rollbacks.pop_back();
+    for(int i=isize(journal)-1; i>=0; i--) {
+      auto& j = journal[i];
+      switch(j.type) {
+        case jtype::cell:
+          copy_metadata(cells[j.index].first, &cells[j.index].second);
+          break;
+        case jtype::bytes:
+          memcpy(j.ptr, &bytes[j.index], j.size);
+          break;
+        case jtype::closure:
+          rollbacks[j.index]();
+          break;
+        case jtype::pop_push:
+          pushes.pop_back();
+          break;
+        }
       }
+    clear();
+    }
+
+  /** \brief Forget the journal; the buffers keep their capacity, so that the next move does not allocate. */
+  void clear() {
+    journal.clear();
+    cells.clear();
+    bytes.clear();
     rollbacks.clear();
     commits.clear();
     }
@@ -465,16 +507,22 @@ struct changes_t {
   /** \brief The changes to cell c will be rolled back when rollback() is called. */
   void ccell(cell *c) {
     if(!on) return;
-    gcell a = *c;
-    rollbacks.push_back([c, a] { copy_metadata(c, &a); });
+    journal.push_back(journal_entry{jtype::cell, isize(cells), 0, nullptr});
+    cells.emplace_back(c, *c);
+    }
+
+  /** \brief The size bytes at ptr will be restored when rollback() is called. */
+  void keep_bytes(void *ptr, int size) {
+    if(!on) return;
+    journal.push_back(journal_entry{jtype::bytes, isize(bytes), size, ptr});
+    bytes.insert(bytes.end(), (char*) ptr, (char*) ptr + size);
     }
   
   /** \brief Set the value of what to value. This change will be rolled back if necessary. */
   template<class T> void value_set(T& what, T value) {
     if(!on) { what = value; return; }
     if(what == value) return;
-    T old = what;
-    rollbacks.push_back([&what, old] { what = old; });
+    value_keep(what);
     what = value;
     }
 
@@ -490,8 +538,16 @@ struct changes_t {
 
   template<class T> void value_keep(T& what) {
     if(!on) return;
+    keep(what, std::is_trivially_copyable<T>());
+    }
+
+  template<class T> void keep(T& what, std::true_type) {
+    keep_bytes(&what, sizeof(T));
+    }
+
+  template<class T> void keep(T& what, std::false_type) {
     T old = what;
-    rollbacks.push_back([&what, old] { what = old; });
+    at_rollback([&what, old] { what = old; });
     }
   
   /** \brief Like value_keep but for maps. */
@@ -516,14 +572,15 @@ struct changes_t {
   /** \brief Perform the given action on rollback. */
 
   void at_rollback(reaction_t act) {
-    if(on) rollbacks.emplace_back(act);
+    if(!on) return;
+    journal.push_back(journal_entry{jtype::closure, isize(rollbacks), 0, nullptr});
+    rollbacks.emplace_back(act);
     }
 
   void push_push(cell *tgt) {
     pushes.push_back(tgt);
-    auto v = [] { pushes.pop_back(); };
-    rollbacks.push_back(v);
-    commits.push_back(v);
+    journal.push_back(journal_entry{jtype::pop_push, 0, 0, nullptr});
+    commits.push_back([] { pushes.pop_back(); });
     }
   };
 #endif
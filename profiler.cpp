@@ -0,0 +1,211 @@
+// Hyperbolic Rogue -- frame profiler
+// Copyright (C) 2011-2021 Zeno Rogue, see 'hyper.cpp' for details
+
+/** \file profiler.cpp
+ *  \brief lightweight scoped timers and counters, dumped in the Chrome trace format
+ *
+ *  Compiled in only with CAP_PROFILING. Use PROFILE("name") to time the current scope,
+ *  PROFILE_SUM("name") to accumulate the time spent in a scope entered many times per frame,
+ *  and PROFILE_COUNT("name", x) to add x to a per-frame counter. Nothing is recorded
+ *  unless `-profile-out file.json` has been given. Only the main thread should record.
+ */
+
+#include "hyper.h"
+namespace hr {
+
+#if HDR
+#if CAP_PROFILING
+#define PROFILE(name) hr::profiler::scope _profile_scope(name)
+#define PROFILE_SUM(name) hr::profiler::accumulator _profile_sum(name)
+#define PROFILE_COUNT(name, x) (hr::profiler::on ? hr::profiler::count(name, x) : void())
+#else
+#define PROFILE(name)
+#define PROFILE_SUM(name)
+#define PROFILE_COUNT(name, x) ((void) 0)
+#endif
+#endif
+
+#if CAP_PROFILING
+EX namespace profiler {
+
+#if HDR
+/** a single timed scope, times in microseconds since the start of the program */
+struct event {
+  const char *name;
+  double start, duration;
+  int depth;
+  };
+
+/** a per-frame counter; accumulated times are stored as counters too, in milliseconds */
+struct counter {
+  const char *name;
+  double value;
+  int active;
+  };
+
+struct frame_record {
+  int id;
+  double start, end;
+  vector<event> events;
+  vector<counter> counters;
+  };
+
+struct scope {
+  int frame, index;
+  scope(const char *name);
+  ~scope();
+  };
+
+struct accumulator {
+  const char *name;
+  bool outer;
+  double entered;
+  accumulator(const char *name);
+  ~accumulator();
+  };
+#endif
+
+/** is the profiler recording? */
+EX bool on = false;
+
+/** the number of frames kept in the ring buffer */
+EX int max_frames = 600;
+
+EX string output_file;
+
+vector<frame_record> frames;
+int frame_count;
+int depth;
+
+std::chrono::steady_clock::time_point time_zero = std::chrono::steady_clock::now();
+
+EX double now() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - time_zero).count();
+  }
+
+frame_record& current() {
+  if(frames.empty()) {
+    frames.resize(max_frames);
+    frames[0].id = 0;
+    frames[0].start = now();
+    frame_count = 1;
+    }
+  return frames[(frame_count-1) % isize(frames)];
+  }
+
+/** close the current frame and start a new one, reusing the oldest slot of the ring */
+EX void next_frame() {
+  if(!on) return;
+  double t = now();
+  current().end = t;
+  auto& f = frames[frame_count % isize(frames)];
+  f.id = frame_count++;
+  f.start = t;
+  f.events.clear();
+  f.counters.clear();
+  }
+
+counter& find_counter(const char *name) {
+  auto& f = current();
+  for(auto& c: f.counters)
+    if(c.name == name || strcmp(c.name, name) == 0) return c;
+  f.counters.push_back(counter{name, 0, 0});
+  return f.counters.back();
+  }
+
+EX void count(const char *name, double x) {
+  find_counter(name).value += x;
+  }
+
+scope::scope(const char *name) {
+  if(!on) { index = -1; return; }
+  auto& f = current();
+  frame = f.id;
+  index = isize(f.events);
+  f.events.push_back(event{name, now(), 0, depth++});
+  }
+
+scope::~scope() {
+  if(index < 0 || !on) return;
+  auto& f = current();
+  depth--;
+  /* the frame may have been closed inside this scope */
+  if(f.id == frame) f.events[index].duration = now() - f.events[index].start;
+  }
+
+/* recursive calls (e.g. setdist) are only timed in the outermost call */
+accumulator::accumulator(const char *_name) : name(_name) {
+  outer = false;
+  if(!on) return;
+  outer = !find_counter(name).active++;
+  if(outer) entered = now();
+  }
+
+accumulator::~accumulator() {
+  if(!on) return;
+  /* look the counter up again, since the frame may have changed in the meantime */
+  auto& c = find_counter(name);
+  if(c.active) c.active--;
+  if(outer) c.value += (now() - entered) / 1000;
+  }
+
+string json_escape(const char *s) {
+  string res;
+  for(; *s; s++) {
+    if(*s == '"' || *s == '\\') res += '\\';
+    res += *s;
+    }
+  return res;
+  }
+
+/** write the frames in the ring buffer in the Chrome trace format (chrome://tracing, Perfetto) */
+EX void dump(const string& fname) {
+  if(frames.empty()) return;
+  current().end = now();
+  FILE *f = fopen(fname.c_str(), "wt");
+  if(!f) { println(hlog, "could not write profile to ", fname); return; }
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"HyperRogue\"}}");
+  int first = max(0, frame_count - isize(frames));
+  for(int i=first; i<frame_count; i++) {
+    auto& fr = frames[i % isize(frames)];
+    fprintf(f, ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d}}", fr.start, fr.end - fr.start, fr.id);
+    for(auto& e: fr.events)
+      fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%d}}", json_escape(e.name).c_str(), e.start, e.duration, e.depth);
+    for(auto& c: fr.counters) {
+      string n = json_escape(c.name);
+      fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"%s\":%.6g}}", n.c_str(), fr.start, n.c_str(), c.value);
+      }
+    }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  }
+
+void dump_at_exit() {
+  if(on) dump(output_file);
+  }
+
+#if CAP_COMMANDLINE
+int read_args() {
+  using namespace arg;
+  if(0) ;
+  else if(argis("-profile-out")) {
+    shift(); output_file = args();
+    if(!on) atexit(dump_at_exit);
+    on = true;
+    }
+  else if(argis("-profile-frames")) {
+    shift(); max_frames = max(argi(), 1);
+    frames.clear(); frame_count = 0;
+    }
+  else return 1;
+  return 0;
+  }
+
+auto ah = addHook(hooks_args, 0, read_args);
+#endif
+
+EX }
+#endif
+
+}
@@ -1016,8 +1016,8 @@ void create_matrices() {
   int id = 0;
   while(!dq::drawqueue_c.empty()) {
     auto& p = dq::drawqueue_c.front();
-    cell*& c = p.first;
-    shiftmatrix& V = p.second;
+    cell *c = p.first;
+    shiftmatrix V = p.second;
     current_display->all_drawn_copies[c].push_back(V);
     gmatrix[p.first] = p.second;
     if(id < draw_per_level) {
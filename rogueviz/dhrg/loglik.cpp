@@ -289,19 +289,25 @@ void writestats() {
   println(hlog, "Compression ratio = %", (placement_loglik+loglik_opt)/loglik_chaos);
   }
 
+/* run f(0), ..., f(threads-1) in the thread pool */
+void run_threads(const std::function<void(int)>& f) {
+#ifndef USE_THREADS
+  f(0);
+#else
+  rogueviz::run_parallel(threads, f);
+#endif
+  }
+
 template<class T> auto parallelize(long long N, T action) -> decltype(action(0,0)) {
 #ifndef USE_THREADS
   return action(0,N);
 #else
   if(threads == 1) return action(0,N);
-  std::vector<std::thread> v;
   typedef decltype(action(0,0)) Res;
   std::vector<Res> results(threads);
-  for(int k=0; k<threads; k++)
-    v.emplace_back([&,k] () { 
-      results[k] = action(N*k/threads, N*(k+1)/threads); 
-      });
-  for(std::thread& t:v) t.join();
+  run_threads([&] (int k) {
+    results[k] = action(N*k/threads, N*(k+1)/threads); 
+    });
   Res res = 0;
   for(Res r: results) res += r;
   return res;
@@ -326,39 +332,78 @@ ld precise_hdist(hyperpoint vi, hyperpoint vj) {
   return acosh(v);
   }
 
+/** vertexcoords in polar coordinates, one array per value, so that the loops over j
+ *  in approx_dists can be vectorized */
+struct polar_coords {
+  vector<double> exp_r, exp_minus_r, sinh_r, cos_phi, sin_phi;
+  };
+
+polar_coords polar_vertexcoords() {
+  polar_coords P;
+  for(auto& h: vertexcoords) {
+    double r = acosh(h[2]);
+    double phi = atan2(h[0], h[1]);
+    P.exp_r.push_back(exp(r));
+    P.exp_minus_r.push_back(exp(-r));
+    P.sinh_r.push_back(sinh(r));
+    P.cos_phi.push_back(cos(phi));
+    P.sin_phi.push_back(sin(phi));
+    }
+  return P;
+  }
+
+/** out[j-j0] := the distance between vertices i and j, for j in [j0, j1); the same as precise_hdist, but
+ *  cosh(da-db) is computed from exp(da) and exp(-db), and 1-cos(phia-phib) from the unit vectors,
+ *  so that the only transcendental function called for each pair is acosh */
+void approx_dists(const polar_coords& P, int i, int j0, int j1, double *out) {
+  double ea = P.exp_r[i], ema = P.exp_minus_r[i], sa = P.sinh_r[i], ca = P.cos_phi[i], sna = P.sin_phi[i];
+  const double *eb = &P.exp_r[0], *emb = &P.exp_minus_r[0], *sb = &P.sinh_r[0], *cb = &P.cos_phi[0], *snb = &P.sin_phi[0];
+  for(int j=j0; j<j1; j++) {
+    double dc = ca - cb[j], ds = sna - snb[j];
+    out[j-j0] = (ea * emb[j] + ema * eb[j]) / 2 + sa * sb[j] * (dc*dc + ds*ds) / 2;
+    }
+  for(int j=j0; j<j1; j++) {
+    double& v = out[j-j0];
+    v = v < 1 ? 0 : acosh(v);
+    }
+  }
+
+/* the pairs are computed in tiles of tile_rows x tile_cols, so that the columns stay in the cache */
+const int tile_rows = 64, tile_cols = 1024;
+
 void build_disttable_approx() {
   indenter_finish im("build_disttable_approx");
 
   array<ll, 2> zero = {0, 0};
 
   using namespace rogueviz;
-
-  std::vector<vector<array<ll, 2>>> results(threads);
-  std::vector<std::thread> v;
-  for(int k=0; k<threads; k++)
-    v.emplace_back([&,k] () {
-      auto& dt = results[k];
-      int tab[N];
-      for(int i=0; i<N; i++) tab[i] = N;
-      auto p = k ? nullptr : new progressbar(N/threads, "build_disttable_approx");
-      for(int i=k; i<N; i+=threads) {
-        if(p) (*p)++;
-        for(auto p: vdata[i].edges) {
-          int j = p.second->i ^ p.second->j ^ i;
-          if(j<i) tab[j] = i;
-          }
-        for(int j=0; j<i; j++) {
-          ld dist = precise_hdist(vertexcoords[i], vertexcoords[j]);
-          if(dist < 0) continue;
-          int dista = dist * llcont_approx_prec;
+  
+  polar_coords P = polar_vertexcoords();
+  
+  /* first count all the pairs as non-edges, in per-thread bins */
+  int tiles = (N + tile_rows - 1) / tile_rows;
+  std::vector<vector<ll>> results(threads);
+  run_threads([&] (int k) {
+    auto& dt = results[k];
+    vector<double> dists(tile_cols);
+    auto p = k ? nullptr : new progressbar(tiles/threads, "build_disttable_approx");
+    for(int t=k; t<tiles; t+=threads) {
+      if(p) (*p)++;
+      int i0 = t * tile_rows, i1 = min(i0 + tile_rows, N);
+      for(int j0=0; j0<i1-1; j0+=tile_cols)
+      for(int i=max(i0, j0+1); i<i1; i++) {
+        int j1 = min(j0 + tile_cols, i);
+        approx_dists(P, i, j0, j1, &dists[0]);
+        for(int j=0; j<j1-j0; j++) {
+          int dista = dists[j] * llcont_approx_prec;
           if(isize(dt) < dista+1)
-            dt.resize(dista+1, zero);
-          dt[dista][(tab[j] == i) ? 1 : 0]++;
+            dt.resize(dista+1, 0);
+          dt[dista]++;
           }
         }
-      if(p) delete p;
-      });
-  for(std::thread& t:v) t.join();
+      }
+    if(p) delete p;
+    });
   
   int mx = 0;
   for(auto& r: results) mx = max(mx, isize(r));
@@ -367,8 +412,21 @@ void build_disttable_approx() {
   
   for(auto& r: results)
     for(int i=0; i<isize(r); i++) 
-      for(int j=0; j<2; j++)
-        disttable_approx[i][j] += r[i][j];
+      disttable_approx[i][0] += r[i];
+  
+  /* then move the edges to the other column */
+  set<pair<int, int>> edges;
+  for(int i=0; i<N; i++)
+    for(auto p: vdata[i].edges) {
+      int j = p.second->i ^ p.second->j ^ i;
+      if(j<i) edges.emplace(i, j);
+      }
+  for(auto e: edges) {
+    double dist;
+    approx_dists(P, e.first, e.second, e.second+1, &dist);
+    auto& d = disttable_approx[int(dist * llcont_approx_prec)];
+    d[0]--; d[1]++;
+    }
   }
 
 ld loglik_cont_approx(logistic& l) {
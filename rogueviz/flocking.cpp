@@ -16,7 +16,11 @@
 
 // press 'o' when flocking active to change the parameters.
 
+// measuring the simulation speed (-threads N to use N threads):
+//    -geo 4 -flocking 1000 -flockrun 20 -exit
+
 #include "rogueviz.h"
+#include <chrono>
 
 namespace rogueviz {
 
@@ -33,7 +37,28 @@ namespace flocking {
   
   ld follow_dist = 0;
   
-  map<cell*, map<cell*, transmatrix>> relmatrices;
+  /** the cells of the manifold, numbered in the order of allcells */
+  vector<cell*> cells;
+  std::unordered_map<cell*, int> cell_id;
+
+  /** the cells in check_range from cell i are rel[rel_start[i]] ... rel[rel_start[i+1]-1];
+   *  T is the matrix we have to multiply by to change from their coordinates to the coordinates of cell i */
+  struct relmatrix { int id; transmatrix T; };
+  vector<int> rel_start;
+  vector<relmatrix> rel;
+
+  /** the boids are bucketed by cell in every step: the boids on cell i are bucket[bucket_start[i]] ...
+   *  bucket[bucket_start[i+1]-1]; bpos and bvel are the positions and velocity vectors of these boids,
+   *  in the coordinates of their cells */
+  vector<int> bucket_start, bucket;
+  vector<hyperpoint> bpos, bvel;
+
+  /** the time taken by the simulation in the last frame, in ms */
+  ld frame_time;
+
+  ld ms_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<ld, std::milli>(std::chrono::steady_clock::now() - t).count();
+    }
 
   ld ini_speed = .5;
   ld max_speed = 1;
@@ -76,17 +101,28 @@ namespace flocking {
     vector<transmatrix> pats(N);
     vector<transmatrix> oris(N);
     vector<ld> vels(N);
-    using shmup::monster;
     
-    map<cell*, vector<monster*>> monsat;
-
+    int C = isize(cells);
+    vector<int> boid_cell(N);
+    bucket_start.assign(C+1, 0);
     for(int i=0; i<N; i++) {
-      vertexdata& vd = vdata[i];
-      auto m = vd.m;
-      monsat[m->base].push_back(m);
+      boid_cell[i] = cell_id.at(vdata[i].m->base);
+      bucket_start[boid_cell[i]+1]++;
+      }
+    for(int c=0; c<C; c++) bucket_start[c+1] += bucket_start[c];
+    bucket.resize(N); bpos.resize(N); bvel.resize(N);
+    vector<int> filled(bucket_start.begin(), bucket_start.end()-1);
+    for(int i=0; i<N; i++) {
+      auto m = vdata[i].m;
+      int k = filled[boid_cell[i]]++;
+      bucket[k] = i;
+      bpos[k] = tC0(m->at);
+      bvel[k] = m->at * hpxyz(m->vel, 0, 0);
       }
     
     lines.clear();
+    /* lines found while computing the boids on cell c, merged in order afterwards */
+    vector<vector<tuple<shiftpoint, shiftpoint, color_t>>> cell_lines(draw_lines ? C : 0);
     
     if(swarm) for(int i=0; i<N; i++) {
       vertexdata& vd = vdata[i];
@@ -99,7 +135,8 @@ namespace flocking {
       virtualRebase(m);
       }
     
-    if(!swarm) parallelize(N, [&monsat, &d, &vels, &pats, &oris] (int a, int b) { for(int i=a; i<b; i++) {
+    if(!swarm) parallelize(C, [&d, &vels, &pats, &oris, &cell_lines] (int a, int b) { for(int c=a; c<b; c++) for(int k=bucket_start[c]; k<bucket_start[c+1]; k++) {
+      int i = bucket[k];
       vertexdata& vd = vdata[i];
       auto m = vd.m;
       
@@ -134,16 +171,17 @@ namespace flocking {
       hyperpoint coh = hpxyz(0, 0, 0);
       int coh_count = 0;
       
-      for(auto& p: relmatrices[m->base]) {
-        auto f = monsat.find(p.first);
-        if(f != monsat.end()) for(auto m2: f->second) if(m != m2) {
-          ld vel2 = m2->vel;
-          transmatrix at2 = I * p.second * m2->at;
-
-          // at2 is like m2->at but relative to m->at
+      for(int r=rel_start[c]; r<rel_start[c+1]; r++) {
+        int c2 = rel[r].id;
+        if(bucket_start[c2] == bucket_start[c2+1]) continue;
+        // M changes from the coordinates of c2 to the coordinates relative to m->at
+        transmatrix M = I * rel[r].T;
+        for(int k2=bucket_start[c2]; k2<bucket_start[c2+1]; k2++) if(k2 != k) {
+          // the position of m2 relative to m->at (like tC0(at2) for at2 = M * m2->at)
+          hyperpoint h2 = M * bpos[k2];
           
           // m2's position relative to m (tC0 means *(0,0,1))
-          hyperpoint ac = inverse_exp(shiftless(tC0(at2)));
+          hyperpoint ac = inverse_exp(shiftless(h2));
           if(use_rot) ac = Rot * ac;
           
           // distance and azimuth to m2
@@ -158,7 +196,7 @@ namespace flocking {
             
             // note: in nonisotropic it is not clear whether we should
             // use gpushxto0, or parallel transport along the shortest geodesic
-            align += gpushxto0(tC0(at2)) * at2 * hpxyz(vel2, 0, 0);
+            align += gpushxto0(h2) * (M * bvel[k2]);
             align_count++;
             col |= 0xFF0040;
             }
@@ -176,7 +214,7 @@ namespace flocking {
             }
           
           if(col && draw_lines)
-            lines.emplace_back(m->pat * C0, m->pat * at2 * C0, col);          
+            cell_lines[c].emplace_back(m->pat * C0, m->pat * h2, col);
           }
         }
       
@@ -211,6 +249,8 @@ namespace flocking {
         }
       
       } return 0; });
+    
+    for(auto& cl: cell_lines) for(auto& l: cl) lines.push_back(l);
       
     if(!swarm) for(int i=0; i<N; i++) {
       vertexdata& vd = vdata[i];
@@ -226,7 +266,9 @@ namespace flocking {
     }
 
   bool turn(int delta) {
+    auto t = std::chrono::steady_clock::now();
     simulate(delta), timetowait = 0;
+    frame_time = ms_since(t);
     
     if(follow) {
 
@@ -351,6 +393,15 @@ namespace flocking {
     else if(argis("-threads")) {
       shift(); threads = argi();
       }
+    // run the simulation for the given number of frames of 'precision' ms, and report the time
+    else if(argis("-flockrun")) {
+      PHASEFROM(3);
+      shift(); int frames = argi();
+      auto t = std::chrono::steady_clock::now();
+      for(int i=0; i<frames; i++) simulate(precision);
+      ld total = ms_since(t);
+      println(hlog, "flocking: ", N, " boids, ", frames, " frames in ", fts(total), " ms (", fts(total / max(frames, 1)), " ms per frame)");
+      }
     else return 1;
     return 0;
     }
@@ -425,6 +476,8 @@ namespace flocking {
         );
       });
   
+    dialog::addInfo(its(N) + " boids, simulation time " + fts(frame_time) + " ms per frame");
+
     dialog::addSelItem("number of boids", its(N), 'n');
     dialog::add_action([]() {
       dialog::editNumber(N, 0, 1000, 1, 20, "", "");
@@ -493,20 +546,25 @@ bool drawVertex(const shiftmatrix &V, cell *c, shmup::monster *m) {
     const auto v = currentmap->allcells();
     
     printf("computing relmatrices...\n");
-    // relmatrices[c1][c2] is the matrix we have to multiply by to 
-    // change from c1-relative coordinates to c2-relative coordinates
+    cells.assign(v.begin(), v.end());
+    cell_id.clear();
+    for(int i=0; i<isize(cells); i++) cell_id[cells[i]] = i;
+    rel_start.clear();
+    rel.clear();
     for(cell* c1: v) {
+      rel_start.push_back(isize(rel));
       manual_celllister cl;
       cl.add(c1);
       for(int i=0; i<isize(cl.lst); i++) {
         cell *c2 = cl.lst[i];
         transmatrix T = calc_relative_matrix(c2, c1, C0);
         if(hypot_d(WDIM, inverse_exp(shiftless(tC0(T)))) <= check_range) {
-          relmatrices[c1][c2] = T;
+          rel.push_back(relmatrix{cell_id.at(c2), T});
           forCellEx(c3, c2) cl.add(c3);
           }
         }
       }
+    rel_start.push_back(isize(rel));
     
     ld angle;
     if(swarm) angle = hrand(1000);
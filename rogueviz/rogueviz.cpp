@@ -1120,6 +1120,14 @@ void o_key(o_funcs& v) {
   v.push_back(named_dialog(XLAT("RogueViz graph viz settings"), rogueviz::showMenu));
   }
 
+void run_parallel(int n, const std::function<void(int)>& f) {
+  #if CAP_THREAD
+  tasks::parallel_for(0, n, 1, [&f] (int a, int b) { for(int k=a; k<b; k++) f(k); });
+  #else
+  for(int k=0; k<n; k++) f(k);
+  #endif
+  }
+
 auto hooks  = 
 #if CAP_COMMANDLINE
   addHook(hooks_args, 100, readArgs) +
@@ -346,16 +346,17 @@ namespace objmodels {
   /* parallelize a computation */
   inline int threads = 1;
 
+  /** call f(0), ..., f(n-1) in parallel (in the thread pool from tasks.cpp) and wait for all of them */
+  void run_parallel(int n, const std::function<void(int)>& f);
+
   template<class T> auto parallelize(long long N, T action) -> decltype(action(0,0)) {
     if(threads == 1) return action(0,N);
-    std::vector<std::thread> v;
     typedef decltype(action(0,0)) Res;
     std::vector<Res> results(threads);
-    for(int k=0; k<threads; k++)
-      v.emplace_back([&,k] () { 
-        results[k] = action(N*k/threads, N*(k+1)/threads); 
-        });
-    for(std::thread& t:v) t.join();
+    int nt = threads;
+    run_parallel(nt, [&] (int k) {
+      results[k] = action(N*k/nt, N*(k+1)/nt);
+      });
     Res res = 0;
     for(Res r: results) res += r;
     return res;
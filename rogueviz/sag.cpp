@@ -43,8 +43,44 @@ namespace sag {
   /** all the SAG cells */
   vector<cell*> sagcells;
 
-  /** table of distances between SAG cells */
-  vector<vector<int>> sagdist;
+  /** how the distances between SAG cells are stored */
+  enum eSagdistMode { sdAuto, sdFull, sdPacked, sdOnDemand };
+
+  /** sdAuto uses sdPacked if the table fits in sagdist_memory megabytes, and sdOnDemand otherwise */
+  eSagdistMode sagdist_mode = sdAuto;
+  int sagdist_memory = 2048;
+
+  /** the number of rows cached by each thread in sdOnDemand mode (for graph distances); 0 = as many as fit in sagdist_memory */
+  int sagdist_cache_rows = 0;
+
+  /** distances from a single SAG cell */
+  struct sagdist_row {
+    const int *full;
+    const unsigned short *packed;
+    int i;
+    int operator [] (int j) const;
+    };
+
+  /** table of distances between SAG cells: sagdist[i][j] */
+  struct sagdist_table {
+    int N;
+    eSagdistMode mode;
+    /** N*N entries, in sdFull and sdPacked modes */
+    vector<int> full;
+    vector<unsigned short> packed;
+    /** positions of SAG cells, for geometric distances in sdOnDemand mode */
+    vector<hyperpoint> where;
+    /** changed whenever the table is recomputed, to invalidate the row caches */
+    int generation;
+    /** the number of rows cached by each thread in sdOnDemand mode */
+    int cache_rows;
+    sagdist_row operator [] (int i) const;
+    int compute(int i, int j) const;
+    void compute_row(int i, int *row) const;
+    const int *cached_row(int i) const;
+    };
+
+  sagdist_table sagdist;
 
   /** what node is on sagcells[i] */
   vector<int> sagnode;
@@ -121,30 +157,179 @@ namespace sag {
           visit(ids[c0->move(d)], T0 * currentmap->adj(c0, d));
       }
     
-    if(gdist_prec) {
-      for(int i=0; i<N; i++)
-      for(int j=0; j<N; j++)
-        sagdist[i][j] = (pdist(tC0(cell_matrix[i]), tC0(cell_matrix[j])) + .5) * gdist_prec;
-      }
-    
-    else {
-      sagdist.clear();
-      sagdist.resize(N);
-      for(int i=0; i<N; i++) {
-        auto &sdi = sagdist[i];
-        sdi.resize(N, N);
-        vector<int> q;
-        auto visit = [&] (int j, int dist) { if(sdi[j] < N) return; sdi[j] = dist; q.push_back(j); };
-        visit(i, 0);
-        for(int j=0; j<isize(q); j++) for(int k: neighbors[q[j]]) visit(k, sdi[q[j]]+1);
+    auto& sd = sagdist;
+    sd.N = N;
+    sd.generation++;
+    sd.full.clear();
+    sd.packed.clear();
+    sd.where.resize(N);
+    for(int i=0; i<N; i++) sd.where[i] = tC0(cell_matrix[i]);
+
+    sd.mode = sagdist_mode;
+    if(sd.mode == sdAuto)
+      sd.mode = size_t(N) * N * sizeof(unsigned short) <= (size_t(sagdist_memory) << 20) ? sdPacked : sdOnDemand;
+
+    dynamicval<int> dt(rogueviz::threads, threads);
+
+    if(sd.mode == sdOnDemand) {
+      if(!gdist_prec) {
+        sd.cache_rows = sagdist_cache_rows;
+        if(!sd.cache_rows) sd.cache_rows = max<size_t>((size_t(sagdist_memory) << 20) / (size_t(N) * sizeof(int) * max(threads, 1)), 1);
+        sd.cache_rows = min(sd.cache_rows, N);
+        if(sd.cache_rows < N)
+          println(hlog, "warning: only ", sd.cache_rows, " of ", N, " rows of SAG distances fit in the cache of each thread; every other row is a BFS, so the annealing will be slow (see -sagdist-memory)");
+        }
+      /* we only need an upper bound on the distances here */
+      vector<int> row0(N);
+      sd.compute_row(0, &row0[0]);
+      int far = 0;
+      for(int x: row0) far = max(far, x);
+      if(!gdist_prec)
+        max_sag_dist = far >= N ? N : min(N-1, 2 * far);
+      else if(nonisotropic || hybri) {
+        /* pdist is not a metric in Solv, and elsewhere geo_dist goes through the approximate inverse_exp,
+         * so the triangle inequality does not give a bound; find the exact maximum */
+        vector<int> rowmax(N);
+        parallelize(N, [&] (int a, int b) {
+          vector<int> row(N);
+          for(int i=a; i<b; i++) {
+            sd.compute_row(i, &row[0]);
+            rowmax[i] = *max_element(row.begin(), row.end());
+            }
+          return 0;
+          });
+        max_sag_dist = *max_element(rowmax.begin(), rowmax.end());
+        }
+      else {
+        ld fard = 0;
+        for(int j=0; j<N; j++) fard = max(fard, pdist(sd.where[0], sd.where[j]));
+        max_sag_dist = int((2 * fard + .5) * gdist_prec) + 1;
         }
+      max_sag_dist++;
+      return;
       }
-    
+
+    vector<int> rowmax(N);
+    auto fill = [&] {
+      if(sd.mode == sdFull) sd.full.resize(size_t(N) * N);
+      else sd.packed.resize(size_t(N) * N);
+      parallelize(N, [&] (int a, int b) {
+        vector<int> row(N);
+        for(int i=a; i<b; i++) {
+          sd.compute_row(i, &row[0]);
+          int m = 0;
+          for(int x: row) m = max(m, x);
+          rowmax[i] = m;
+          if(sd.mode == sdFull)
+            copy(row.begin(), row.end(), sd.full.begin() + size_t(i) * N);
+          else for(int j=0; j<N; j++)
+            sd.packed[size_t(i) * N + j] = min(row[j], 65535);
+          }
+        return 0;
+        });
+      };
+
+    if(sd.mode == sdPacked && !gdist_prec && N > 65535) sd.mode = sdFull;
+    fill();
+
     max_sag_dist = 0;
-    for(auto& d: sagdist) for(auto& x: d) max_sag_dist = max(max_sag_dist, x);
+    for(int m: rowmax) max_sag_dist = max(max_sag_dist, m);
+    if(sd.mode == sdPacked && max_sag_dist > 65535) {
+      /* does not fit in 16 bits */
+      sd.packed.clear();
+      sd.mode = sdFull;
+      fill();
+      }
     max_sag_dist++;
     }
 
+  void sagdist_table::compute_row(int i, int *row) const {
+    if(gdist_prec && !sol) {
+      dispatch_geometry([&] (auto p) {
+        for(int j=0; j<N; j++) row[j] = (p.geo_dist(where[i], where[j]) + .5) * gdist_prec;
+        });
+      return;
+      }
+    if(gdist_prec) {
+      for(int j=0; j<N; j++) row[j] = compute(i, j);
+      return;
+      }
+    for(int j=0; j<N; j++) row[j] = N;
+    vector<int> q;
+    auto visit = [&] (int j, int dist) { if(row[j] < N) return; row[j] = dist; q.push_back(j); };
+    visit(i, 0);
+    for(int j=0; j<isize(q); j++) for(int k: neighbors[q[j]]) visit(k, row[q[j]]+1);
+    }
+
+  int sagdist_table::compute(int i, int j) const {
+    if(gdist_prec) return (pdist(where[i], where[j]) + .5) * gdist_prec;
+    return cached_row(i)[j];
+    }
+
+  const int *sagdist_table::cached_row(int i) const {
+    /* the rows in a list ordered by the last use; the least recently used row is replaced */
+    struct row_cache {
+      int generation = -1;
+      /** slot_of[i] is the slot of row i, or -1 */
+      vector<int> slot_of;
+      /** the row in each slot, and the neighbors in the list */
+      vector<int> id, prev, next;
+      vector<vector<int>> rows;
+      /** the most and least recently used slots */
+      int first = -1, last = -1;
+      void unlink(int s) {
+        (prev[s] >= 0 ? next[prev[s]] : first) = next[s];
+        (next[s] >= 0 ? prev[next[s]] : last) = prev[s];
+        }
+      void push_front(int s) {
+        prev[s] = -1; next[s] = first;
+        (first >= 0 ? prev[first] : last) = s;
+        first = s;
+        }
+      };
+    static thread_local row_cache cache;
+    auto& c = cache;
+    if(c.generation != generation) {
+      c.generation = generation;
+      c.slot_of.assign(N, -1);
+      c.id.clear(); c.prev.clear(); c.next.clear(); c.rows.clear();
+      c.first = c.last = -1;
+      }
+    int s = c.slot_of[i];
+    if(s >= 0) {
+      if(s != c.first) c.unlink(s), c.push_front(s);
+      return &c.rows[s][0];
+      }
+    if(isize(c.rows) < cache_rows) {
+      s = isize(c.rows);
+      c.rows.emplace_back(N);
+      c.id.push_back(i); c.prev.push_back(-1); c.next.push_back(-1);
+      }
+    else {
+      s = c.last;
+      c.unlink(s);
+      c.slot_of[c.id[s]] = -1;
+      c.id[s] = i;
+      }
+    c.slot_of[i] = s;
+    c.push_front(s);
+    compute_row(i, &c.rows[s][0]);
+    return &c.rows[s][0];
+    }
+
+  sagdist_row sagdist_table::operator [] (int i) const {
+    if(mode == sdFull) return sagdist_row{&full[size_t(i) * N], nullptr, i};
+    if(mode == sdPacked) return sagdist_row{nullptr, &packed[size_t(i) * N], i};
+    if(gdist_prec) return sagdist_row{nullptr, nullptr, i};
+    return sagdist_row{cached_row(i), nullptr, i};
+    }
+
+  int sagdist_row::operator [] (int j) const {
+    if(full) return full[j];
+    if(packed) return packed[j];
+    return sagdist.compute(i, j);
+    }
+
   bool legacy;
 
   /* legacy method */
@@ -182,12 +367,13 @@ namespace sag {
   string hub_filename;
   vector<int> hubval;
   
-  double costat(int vid, int sid) {
+  /** the cost of placing vid at sid, for the given assignment */
+  double costat(const vector<int>& sagid, const vector<int>& sagnode, int vid, int sid) {
     if(vid < 0) return 0;
     double cost = 0;
     
     if(logistic_cost) {
-      auto &s = sagdist[sid];
+      auto s = sagdist[sid];
       for(auto j: edges_yes[vid])
         cost += loglik_tab_y[s[sagid[j]]];
       for(auto j: edges_no[vid])
@@ -213,6 +399,8 @@ namespace sag {
     return cost;
     }
   
+  double costat(int vid, int sid) { return costat(sagid, sagnode, vid, sid); }
+
   // std::mt19937 los;
 
   double cost;
@@ -226,46 +414,63 @@ namespace sag {
       vdata[id].edges[i].second->orig = NULL;
     }
   
-  bool chance(double p) {
-    p *= double(hrngen.max()) + 1;
-    auto l = hrngen();
+  bool chance(double p, std::mt19937& rng) {
+    p *= double(rng.max()) + 1;
+    auto l = rng();
     auto pv = (decltype(l)) p;
     if(l < pv) return true;
-    if(l == pv) return chance(p-pv);
+    if(l == pv) return chance(p-pv, rng);
     return false;
     }
 
-  void saiter() {
+  bool chance(double p) { return chance(p, hrngen); }
+
+  /** same as hrand, but using the given generator */
+  int hrand_at(int i, std::mt19937& rng) {
+    unsigned d = rng() - rng.min();
+    long long m = (long long) (rng.max() - rng.min()) + 1;
+    m /= i;
+    d /= m;
+    if(d < (unsigned) i) return d;
+    return hrand_at(i, rng);
+    }
+
+  /** a single step of SA/HC on the given assignment; does not touch the global state, so replicas can run in parallel */
+  void saiter(vector<int>& sagid, vector<int>& sagnode, double& cost, ld temperature, std::mt19937& rng) {
     int DN = isize(sagid);
-    int t1 = hrand(DN);
+    int t1 = hrand_at(DN, rng);
     int sid1 = sagid[t1];
     
     int sid2;
     
-    int s = hrand(4)+1;
+    int s = hrand_at(4, rng)+1;
     
-    if(s == 4) sid2 = hrand(isize(sagcells));
+    if(s == 4) sid2 = hrand_at(isize(sagcells), rng);
     else {
       sid2 = sid1;
-      for(int ii=0; ii<s; ii++) sid2 = hrand_elt(neighbors[sid2]);
+      for(int ii=0; ii<s; ii++) sid2 = neighbors[sid2][hrand_at(isize(neighbors[sid2]), rng)];
       }
     int t2 = sagnode[sid2];
     
     sagnode[sid1] = -1; sagid[t1] = -1;
     sagnode[sid2] = -1; if(t2 >= 0) sagid[t2] = -1;
     
+    auto costat = [&] (int vid, int sid) { return sag::costat(sagid, sagnode, vid, sid); };
+
     double change = 
       costat(t1,sid2) + costat(t2,sid1) - costat(t1,sid1) - costat(t2,sid2);
     
     sagnode[sid1] = t1; sagid[t1] = sid1;
     sagnode[sid2] = t2; if(t2 >= 0) sagid[t2] = sid2;
     
-    if(change > 0 && (sagmode == sagHC || !chance(exp(-change * exp(-temperature))))) return;
+    if(change > 0 && (sagmode == sagHC || !chance(exp(-change * exp(-temperature)), rng))) return;
 
     sagnode[sid1] = t2; sagnode[sid2] = t1;
     sagid[t1] = sid2; if(t2 >= 0) sagid[t2] = sid1;
     cost += change;
     }
+
+  void saiter() { saiter(sagid, sagnode, cost, temperature, hrngen); }
   
   void prepare_graph() {
     int DN = isize(sagid);
@@ -368,6 +573,83 @@ namespace sag {
     reassign();
     }
 
+  /** parallel tempering: replicas at fixed temperatures between hightemp and lowtemp, exchanged every exchange_period iterations */
+  struct sagreplica {
+    vector<int> sagnode, sagid;
+    double cost;
+    ld temperature;
+    std::mt19937 rng;
+    };
+
+  int replicas = 8;
+  int exchange_period = 10000;
+
+  vector<sagreplica> reps;
+
+  /** run parallel tempering for satime seconds; the best assignment found is kept in sagid/sagnode/cost */
+  void dofullsa_tempering(int satime) {
+    sagmode = sagSA;
+    int R = max(replicas, 2);
+    reps.resize(R);
+    for(int i=0; i<R; i++) {
+      auto& r = reps[i];
+      r.sagid = sagid;
+      r.sagnode = sagnode;
+      r.cost = cost;
+      r.temperature = hightemp - i * (hightemp-lowtemp) / (R-1.);
+      r.rng.seed(hrngen());
+      }
+
+    int t1 = SDL_GetTicks();
+    int tl = -999999;
+    int tries = 0, swaps = 0;
+
+    while(true) {
+      int t2 = SDL_GetTicks();
+      if(t2 - t1 > 1000 * satime) break;
+
+      dynamicval<int> dt(rogueviz::threads, threads);
+      parallelize(R, [] (int a, int b) {
+        for(int i=a; i<b; i++) {
+          auto& r = reps[i];
+          for(int j=0; j<exchange_period; j++)
+            saiter(r.sagid, r.sagnode, r.cost, r.temperature, r.rng);
+          }
+        return 0;
+        });
+      numiter += R * exchange_period;
+
+      for(int i=0; i+1<R; i++) {
+        auto& r1 = reps[i];
+        auto& r2 = reps[i+1];
+        double delta = (r1.cost - r2.cost) * (exp(-r1.temperature) - exp(-r2.temperature));
+        tries++;
+        if(delta >= 0 || chance(exp(delta))) {
+          swap(r1.sagid, r2.sagid);
+          swap(r1.sagnode, r2.sagnode);
+          swap(r1.cost, r2.cost);
+          swaps++;
+          }
+        }
+
+      for(auto& r: reps) if(r.cost < cost) {
+        sagid = r.sagid;
+        sagnode = r.sagnode;
+        cost = r.cost;
+        }
+
+      if(t2 - tl > 980) {
+        tl = t2;
+        println(hlog, format("it %8d replicas %d swaps %d/%d cost = %f [coldest: %f]",
+          numiter, R, swaps, tries, double(sag::cost), double(reps.back().cost)));
+        }
+      }
+
+    temperature = -5;
+    sagmode = sagOff;
+    reassign();
+    }
+
   void dofullsa_iterations(int saiter) {
     sagmode = sagSA;
 
@@ -575,9 +857,16 @@ namespace sag {
     
     dhrg::disttable_approx.clear();
     int DN = isize(sagid);
-    for(int i=0; i<DN; i++)
-    for(int j=0; j<i; j++)
-      disttable_add(pdist(i, j), 1, 0);
+    if(sol) {
+      for(int i=0; i<DN; i++)
+      for(int j=0; j<i; j++)
+        disttable_add(pdist(i, j), 1, 0);
+      }
+    else dispatch_geometry([&] (auto p) {
+      for(int i=0; i<DN; i++)
+      for(int j=0; j<i; j++)
+        disttable_add(p.geo_dist(placement[i], placement[j]), 1, 0);
+      });
 
     for(int i=0; i<isize(sagedges); i++) {
       edgeinfo& ei = sagedges[i];
@@ -950,6 +1239,11 @@ void output_stats() {
     sag::save_sag_solution(auto_save);
     }
   println(hlog, "solution: ", sagid);
+  if(!reps.empty()) {
+    vector<double> costs;
+    for(auto& r: reps) costs.push_back(r.cost);
+    println(hlog, "replica costs: ", costs);
+    }
   int DN = isize(sagid);
   ld mAP = compute_mAP();
   dhrg::iddata routing_result;
@@ -958,6 +1252,44 @@ void output_stats() {
   println(hlog, "CSV;", logid++, ";", isize(sagnode), ";", DN, ";", isize(sagedges), ";", lgsag.R, ";", lgsag.T, ";", cost, ";", mAP, ";", routing_result.suc / routing_result.tot, ";", routing_result.routedist / routing_result.bestdist);
   }
 
+/** check that costat gives the same values whichever way the distances are stored, and that max_sag_dist bounds them */
+void check_sagdist_modes() {
+  int DN = isize(sagid);
+  vector<pair<int, int>> probes;
+  for(int i=0; i<1000; i++) probes.emplace_back(hrand(DN), hrand(isize(sagcells)));
+  dynamicval<eSagdistMode> dm(sagdist_mode);
+  dynamicval<int> dc(sagdist_cache_rows);
+  vector<double> ref;
+  bool ok = true;
+  auto check = [&] (eSagdistMode mode, int cache, string name) {
+    sagdist_mode = mode;
+    sagdist_cache_rows = cache;
+    compute_dists();
+    if(logistic_cost) compute_loglik_tab();
+    vector<double> res;
+    for(auto p: probes) res.push_back(costat(p.first, p.second));
+    if(ref.empty()) ref = res;
+    /* the loglik tables have max_sag_dist entries */
+    vector<int> row(isize(sagcells));
+    for(int i=0; i<isize(sagcells); i++) {
+      sagdist.compute_row(i, &row[0]);
+      if(*max_element(row.begin(), row.end()) >= max_sag_dist) res.push_back(-1);
+      }
+    bool same = res == ref;
+    println(hlog, "costat with ", name, ": ", same ? "OK" : "ERROR");
+    if(!same) ok = false;
+    };
+  check(sdFull, 0, "int table");
+  check(sdPacked, 0, "16-bit table");
+  check(sdOnDemand, 0, "distances on demand");
+  check(sdOnDemand, 3, "distances on demand, 3 cached rows");
+  sagdist_mode = dm.backup;
+  sagdist_cache_rows = dc.backup;
+  compute_dists();
+  if(logistic_cost) compute_loglik_tab();
+  if(!ok) exit(1);
+  }
+
 int readArgs() {
 #if CAP_COMMANDLINE
   using namespace arg;
@@ -972,6 +1304,21 @@ int readArgs() {
   else if(argis("-sagminhi")) {
     shift_arg_formula(default_edgetype.visible_from_hi);
     }
+  else if(argis("-sagdist-mode")) {
+    // 0 = auto, 1 = int table, 2 = 16-bit table, 3 = on demand
+    shift(); sag::sagdist_mode = (sag::eSagdistMode) argi();
+    }
+  else if(argis("-sagdist-memory")) {
+    shift(); sag::sagdist_memory = argi();
+    }
+  else if(argis("-sagdist-cache")) {
+    // 0 = as many as fit in -sagdist-memory
+    shift(); sag::sagdist_cache_rows = max(argi(), 0);
+    }
+  else if(argis("-sagdist-check")) {
+    PHASEFROM(3);
+    check_sagdist_modes();
+    }
   else if(argis("-sag_gdist")) {
     shift(); sag::gdist_prec = argi();
     }
@@ -1032,6 +1379,19 @@ int readArgs() {
   else if(argis("-sagfulli")) {
     shift(); sag::dofullsa_iterations(argi());
     }
+// (4b) parallel tempering: -sagfullpt <time in seconds>
+  else if(argis("-sagfullpt")) {
+    shift(); sag::dofullsa_tempering(argi());
+    }
+  else if(argis("-sagreplicas")) {
+    shift(); sag::replicas = argi();
+    }
+  else if(argis("-sagexchange")) {
+    shift(); sag::exchange_period = argi();
+    }
+  else if(argis("-sagthreads")) {
+    shift(); sag::threads = argi();
+    }
   else if(argis("-sagviz")) {
     sag::vizsa_start = SDL_GetTicks();
     shift(); sag::vizsa_len = argi();
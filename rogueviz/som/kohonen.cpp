@@ -464,6 +464,22 @@ struct cellcrawler {
       }
     }
 
+  /* same as sprawl, but does not modify the crawler, so that it can be used by many threads at once */
+  void sprawl_to(const cellwalker& start, vector<cellwalker>& targets) const {
+    targets.resize(isize(data));
+    targets[0] = start;
+    
+    for(int i=1; i<isize(data); i++) {
+      auto& s = data[i];
+      auto& tg = targets[i];
+      tg = targets[s.from];
+      if(!tg.at) continue;
+      tg += s.spin;
+      if(!tg.peek()) tg.at = NULL;
+      else tg += wstep;
+      }
+    }
+
   vector<vector<float>> dispersion;
   };
 
@@ -641,11 +657,133 @@ int krad, kqty;
 
 double ttpower = 1;
 
+/* batch training: if batch_size > 0, each step finds the winners for batch_size samples
+ * (all the samples if batch_size >= samples), and then applies all the updates at once;
+ * the number of threads changes only the rounding (see -som-batch-check) */
+
+int batch_size = 0;
+
+/* neuron weights as a contiguous column-major matrix: nmatrix[k*cells+j] == net[j].net[k] */
+vector<double> nmatrix;
+
+/* find the winners for the given samples; gives the same result as winner() */
+void find_winners(const vector<int>& ids, vector<int>& res) {
+  int N = isize(net);
+  nmatrix.resize(columns * N);
+  for(int j=0; j<N; j++)
+  for(int k=0; k<columns; k++)
+    nmatrix[k*N+j] = net[j].net[k];
+
+  res.resize(isize(ids));
+  const int stile = 16, ntile = 256;
+  parallelize((isize(ids) + stile - 1) / stile, [&] (int a, int b) {
+    vector<double> acc(stile * ntile), bdiff(stile);
+    for(int i0=a*stile; i0<b*stile && i0<isize(ids); i0+=stile) {
+      int i1 = min(i0 + stile, isize(ids));
+      for(int i=i0; i<i1; i++) bdiff[i-i0] = HUGE_VAL, res[i] = -1;
+      for(int j0=0; j0<N; j0+=ntile) {
+        int j1 = min(j0 + ntile, N);
+        for(int i=i0; i<i1; i++) {
+          double *ac = &acc[(i-i0) * ntile];
+          auto& val = data[ids[i]].val;
+          for(int j=j0; j<j1; j++) ac[j-j0] = 0;
+          for(int k=0; k<columns; k++) {
+            const double *row = &nmatrix[k*N];
+            double v = val[k], w = weights[k];
+            for(int j=j0; j<j1; j++) ac[j-j0] += sqr((row[j] - v) * w);
+            }
+          for(int j=j0; j<j1; j++) if(ac[j-j0] < bdiff[i-i0]) bdiff[i-i0] = ac[j-j0], res[i] = j;
+          }
+        }
+      }
+    return 0;
+    });
+  }
+
+void batch_step() {
+  double tt = (t-.5) / tmax;
+  tt = pow(tt, ttpower);
+  double sigma = maxdist * tt;
+
+  bool full = batch_size >= samples;
+  vector<int> ids;
+  if(full) for(int i=0; i<samples; i++) ids.push_back(i);
+  else for(int i=0; i<batch_size; i++) ids.push_back(hrand(samples));
+
+  vector<int> wins;
+  find_winners(ids, wins);
+  whowon.resize(samples);
+  for(int i=0; i<isize(ids); i++) whowon[ids[i]] = &net[wins[i]];
+
+  /* sum the samples won by each neuron, so that each crawler is sprawled once */
+  int N = isize(net);
+  vector<int> qty(N, 0);
+  vector<double> sums(N * columns, 0);
+  for(int i=0; i<isize(ids); i++) {
+    int w = wins[i];
+    qty[w]++;
+    auto& val = data[ids[i]].val;
+    for(int k=0; k<columns; k++) sums[w*columns+k] += val[k];
+    }
+
+  struct active_crawler { int id; cellcrawler *cc; cellwalker start; };
+  vector<active_crawler> active;
+  for(int n=0; n<N; n++) if(qty[n]) {
+    auto cid = get_cellcrawler_id(net[n].where);
+    active.push_back(active_crawler{n, &scc[cid.first], cellwalker(net[n].where, cid.second)});
+    }
+  setindex(true);
+
+  /* each thread sprawls its own range of the active crawlers, and accumulates the updates in its own buffers;
+   * the buffers are then added in the order of the threads */
+  int nt = threads;
+  vector<vector<double>> nums(nt), dens(nt);
+  run_parallel(nt, [&] (int th) {
+    auto& num = nums[th];
+    auto& den = dens[th];
+    num.assign(N * columns, 0);
+    den.assign(N, 0);
+    vector<cellwalker> targets;
+    int a = isize(active) * 1LL * th / nt, b = isize(active) * (th+1LL) / nt;
+    for(int i=a; i<b; i++) {
+      auto& ac = active[i];
+      ac.cc->sprawl_to(ac.start, targets);
+      int dispid = int(isize(ac.cc->dispersion) * tt);
+      for(int q=0; q<isize(targets); q++) {
+        neuron *n2 = getNeuron(targets[q].at);
+        if(!n2) continue;
+        int j = neuronId(*n2);
+        double h = gaussian ? exp(-sqr(ac.cc->data[q].dist/sigma)) : ac.cc->dispersion[dispid][q];
+        if(isnan(h)) continue;
+        den[j] += h * qty[ac.id];
+        for(int k=0; k<columns; k++) num[j*columns+k] += h * sums[ac.id*columns+k];
+        }
+      }
+    });
+
+  auto& num = nums[0];
+  auto& den = dens[0];
+  for(int th=1; th<nt; th++) {
+    for(int j=0; j<N; j++) den[j] += dens[th][j];
+    for(int j=0; j<N*columns; j++) num[j] += nums[th][j];
+    }
+
+  for(int j=0; j<N; j++) if(den[j] > 0) {
+    double f = full ? 1 : min(1., learning_factor * den[j]);
+    for(int k=0; k<columns; k++)
+      net[j].net[k] += f * (num[j*columns+k] / den[j] - net[j].net[k]);
+    }
+
+  t -= min(t, isize(ids)); if(t == 0) analyze();
+  }
+
 void step() {
 
   if(t == 0) return;
   initialize_dispersion();
   initialize_neurons_initial();
+
+  if(batch_size) { batch_step(); return; }
   
   double tt = (t-.5) / tmax;
   tt = pow(tt, ttpower);
@@ -1688,6 +1826,40 @@ int readArgs() {
     // this one can be changed at any moment
     shift_arg_formula(learning_factor);
     }
+  else if(argis("-som-batch")) {
+    // 0 = online training, otherwise the number of samples per batch
+    shift(); batch_size = argi();
+    }
+  else if(argis("-som-threads")) {
+    shift(); threads = argi();
+    }
+
+  else if(argis("-som-batch-check")) {
+    /* train for the given number of steps from the same seed, with one thread and with -som-threads, and compare the weights */
+    shift(); int steps = argi();
+    if(!batch_size) batch_size = samples;
+    /* these use hrand too */
+    initialize_neurons();
+    initialize_dispersion();
+    int nt = threads;
+    auto train = [&] (int th) {
+      threads = th;
+      shrand(1);
+      set_neuron_initial();
+      state |= KS_NEURONS_INI;
+      t = last_analyze_step = tmax;
+      for(int i=0; i<steps && t; i++) step();
+      vector<double> res;
+      for(auto& n: net) for(int k=0; k<columns; k++) res.push_back(n.net[k]);
+      return res;
+      };
+    auto w1 = train(1);
+    auto wn = train(nt);
+    double err = 0;
+    for(int i=0; i<isize(w1); i++) err = max(err, abs(w1[i] - wn[i]) / (1 + abs(w1[i])));
+    println(hlog, "batch SOM with ", nt, " threads: max difference ", err, err < 1e-9 ? " OK" : " ERROR");
+    if(err >= 1e-9) exit(1);
+    }
 
   else if(argis("-som-analyze")) {
     analyze();
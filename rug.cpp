@@ -651,23 +651,20 @@ bool force_euclidean(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp = f
   return nonzero;
   }
 
-bool force(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double d1=1, double d2=1) {
+/** the force in the native geometry, which should be already set; P is the geometry policy */
+template<class P> bool force_native(P, rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double d1=1, double d2=1) {
   if(!m1.valid || !m2.valid) return false;
-  if(rug_euclid() && fast_euclidean) {
-    return force_euclidean(m1, m2, rd, is_anticusp, d1, d2);
-    }
-  USING_NATIVE_GEOMETRY;
   
-  ld t = geo_dist_q(m1.native, m2.native);
+  ld t = P::geo_dist_q(m1.native, m2.native);
   if(is_anticusp && t > rd) return false;
   current_total_error += (t-rd) * (t-rd);
   bool nonzero = abs(t-rd) > err_zero_current;
   double forcev = (t - rd) / 2; // 20.0;
   
-  transmatrix T = iso_inverse(rgpushxto0(m1.native));
-  hyperpoint ie = inverse_exp(shiftless(T * m2.native));
+  transmatrix T = P::iso_inverse(P::rgpushxto0(m1.native));
+  hyperpoint ie = P::inverse_exp(T * m2.native);
 
-  transmatrix iT = rgpushxto0(m1.native);
+  transmatrix iT = P::rgpushxto0(m1.native);
   
   for(int i=0; i<MXDIM; i++) if(std::isnan(m1.native[i])) { 
     addMessage("Failed!");
@@ -675,13 +672,48 @@ bool force(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double
     throw rug_exception();
     }
 
-  m1.native = iT * direct_exp(ie * (d1*forcev/t));
-  m2.native = iT * direct_exp(ie * ((t-d2*forcev)/t));
+  m1.native = iT * P::direct_exp(ie * (d1*forcev/t));
+  m2.native = iT * P::direct_exp(ie * ((t-d2*forcev)/t));
 
   if(nonzero && d2>0) enqueue(&m2);
   return nonzero;
   }
 
+bool force(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double d1=1, double d2=1) {
+  if(!m1.valid || !m2.valid) return false;
+  if(rug_euclid() && fast_euclidean) {
+    return force_euclidean(m1, m2, rd, is_anticusp, d1, d2);
+    }
+  USING_NATIVE_GEOMETRY;
+  return force_native(generic_policy(), m1, m2, rd, is_anticusp, d1, d2);
+  }
+
+/** all the forces on the edges of m, with the geometry dispatched once */
+struct edge_forces {
+  rugpoint *m;
+  bool moved;
+  template<class P> void operator() (P p) {
+    for(auto& e: m->edges)
+      moved = force_native(p, *m, *e.target, e.len) || moved;
+    for(auto& e: m->anticusp_edges)
+      moved = force_native(p, *m, *e.target, anticusp_dist, true) || moved;
+    }
+  };
+
+bool force_edges(rugpoint *m) {
+  edge_forces f{m, false};
+  if(rug_euclid() && fast_euclidean) {
+    for(auto& e: m->edges)
+      f.moved = force_euclidean(*m, *e.target, e.len) || f.moved;
+    for(auto& e: m->anticusp_edges)
+      f.moved = force_euclidean(*m, *e.target, anticusp_dist, true) || f.moved;
+    return f.moved;
+    }
+  USING_NATIVE_GEOMETRY;
+  dispatch_geometry(f);
+  return f.moved;
+  }
+
 vector<pair<ld, rugpoint*> > preset_points;
 
 EX void preset(rugpoint *m) {
@@ -990,15 +1022,7 @@ EX void physics() {
       rugpoint *m = pqueue.front();
       pqueue.pop();
       m->inqueue = false;
-      bool moved = false;
-      
-      for(auto& e: m->edges)
-        moved = force(*m, *e.target, e.len) || moved;
-      
-      for(auto& e: m->anticusp_edges)
-        moved = force(*m, *e.target, anticusp_dist, true) || moved;
-      
-      if(moved) enqueue(m), need_mouseh = true;
+      if(force_edges(m)) enqueue(m), need_mouseh = true;
       }    
 
   }
@@ -686,15 +686,91 @@ EX SDL_Surface *empty_surface(int x, int y, bool alpha) {
 
 #if CAP_PNG
 
-EX void output(SDL_Surface* s, const string& fname) {
-  if(format == screenshot_format::rawfile) {
-    for(int y=0; y<shoty; y++)
-      ignore(write(rawfile_handle, &qpixel(s, 0, y), 4 * shotx));
+void output_now(SDL_Surface* s, const string& fname, screenshot_format f, int handle, int x, int y) {
+  if(f == screenshot_format::rawfile) {
+    for(int iy=0; iy<y; iy++)
+      ignore(write(handle, &qpixel(s, 0, iy), 4 * x));
     }
   else
     IMAGESAVE(s, fname.c_str());
   }
 
+#if CAP_THREAD
+/** \brief the maximum number of frames waiting to be written while recording animations (0 = write synchronously) */
+EX int frame_queue = 4;
+
+/** \brief the number of threads compressing PNG frames; raw video frames are always written by a single thread, in order */
+EX int png_threads = 1;
+
+/** \brief Writes the frames in background threads, so that rendering the next frame overlaps with saving this one. */
+struct frame_writer {
+  struct frame {
+    SDL_Surface *s;
+    string fname;
+    screenshot_format format;
+    int handle, x, y;
+    };
+
+  bool enabled;
+  std::mutex lock;
+  std::condition_variable cv;
+  queue<frame> frames;
+  vector<std::thread> threads;
+  bool stopping;
+
+  void work() {
+    while(true) {
+      frame f;
+      if(1) {
+        std::unique_lock<std::mutex> lk(lock);
+        cv.wait(lk, [this] { return stopping || !frames.empty(); });
+        if(frames.empty()) return;
+        f = std::move(frames.front());
+        frames.pop();
+        }
+      cv.notify_all();
+      output_now(f.s, f.fname, f.format, f.handle, f.x, f.y);
+      SDL_FreeSurface(f.s);
+      }
+    }
+
+  void push(SDL_Surface *s, const string& fname) {
+    if(threads.empty()) {
+      int qty = format == screenshot_format::rawfile ? 1 : max(png_threads, 1);
+      for(int i=0; i<qty; i++) threads.emplace_back([this] { work(); });
+      }
+    frame f{SDL_ConvertSurface(s, s->format, 0), fname, format, rawfile_handle, shotx, shoty};
+    if(1) {
+      std::unique_lock<std::mutex> lk(lock);
+      cv.wait(lk, [this] { return isize(frames) < frame_queue; });
+      frames.push(std::move(f));
+      }
+    cv.notify_all();
+    }
+
+  /** wait until all the frames are written */
+  void finish() {
+    if(1) {
+      std::unique_lock<std::mutex> lk(lock);
+      stopping = true;
+      }
+    cv.notify_all();
+    for(auto& t: threads) t.join();
+    threads.clear();
+    stopping = false;
+    }
+  };
+
+frame_writer writer;
+#endif
+
+EX void output(SDL_Surface* s, const string& fname) {
+  #if CAP_THREAD
+  if(writer.enabled) { writer.push(s, fname); return; }
+  #endif
+  output_now(s, fname, format, rawfile_handle, shotx, shoty);
+  }
+
 EX hookset<bool(string, SDL_Surface*, SDL_Surface*)> hooks_postprocess;
 
 EX void postprocess(string fname, SDL_Surface *sdark, SDL_Surface *sbright) {
@@ -735,6 +811,21 @@ EX void postprocess(string fname, SDL_Surface *sdark, SDL_Surface *sbright) {
   }
 #endif
 
+/** \brief from now on, save the frames in the background (if frame_queue > 0) */
+EX void start_frame_writer() {
+  #if CAP_THREAD && CAP_PNG
+  if(frame_queue > 0) writer.enabled = true;
+  #endif
+  }
+
+/** \brief wait until all the frames are saved, and go back to saving synchronously */
+EX void finish_frame_writer() {
+  #if CAP_THREAD && CAP_PNG
+  writer.enabled = false;
+  writer.finish();
+  #endif
+  }
+
 EX purehookset hooks_take;
 
 #if CAP_PNG
@@ -773,6 +864,9 @@ void render_png(string fname, const function<void()>& what) {
 
 EX void take(string fname, const function<void()>& what IS(default_screenshot_content)) {
 
+  #if CAP_PROFILING
+  profiler::next_frame();
+  #endif
   if(cheater) doOvergenerate();
   
   #if CAP_SVG  
@@ -848,6 +942,14 @@ int png_read_args() {
   else if(argis("-shotxy")) {
     shift(); shotformat = -1; shotx = argi(); shift(); shoty = argi();
     }
+  #if CAP_THREAD && CAP_PNG
+  else if(argis("-shotqueue")) {
+    shift(); frame_queue = argi();
+    }
+  else if(argis("-shotthreads")) {
+    shift(); png_threads = argi();
+    }
+  #endif
   else if(argis("-shothud")) {
     shift(); hide_hud = !argi();
     }
@@ -1170,6 +1272,8 @@ struct animated_parameter {
   ld last;
   string formula;
   reaction_t reaction;
+  /** \brief formula, compiled on first use */
+  exp_program program;
   };
 #endif
 
@@ -1189,7 +1293,7 @@ EX void get_parameter_animation(ld &x, string &s) {
 
 EX void animate_parameter(ld &x, string f, const reaction_t& r) {
   deanimate(x);
-  aps.emplace_back(animated_parameter{&x, x, f, r});
+  aps.emplace_back(animated_parameter{&x, x, f, r, exp_program()});
   }
 
 int ap_changes;
@@ -1199,7 +1303,8 @@ void apply_animated_parameters() {
   for(auto &ap: aps) {
     if(*ap.value != ap.last) continue;
     try {
-      *ap.value = parseld(ap.formula);
+      if(!ap.program.compiled()) ap.program = compile_formula(ap.formula);
+      *ap.value = ap.program.revaluate();
       }
     catch(hr_parse_exception&) {
       continue;
@@ -1392,21 +1497,161 @@ int numturns = 0;
 
 EX hookset<void(int, int)> hooks_record_anim;
 
+/** render only the shard_id-th of shard_count equal parts of the frames (-animrecord-shard k/n) */
+EX int shard_id = 0;
+EX int shard_count = 1;
+
+/** the number of processes rendering the frames in parallel */
+EX int anim_processes = 1;
+
+/** in the processes rendering a part of the frames, the pipe to report the finished frames to */
+int progress_fd = -1;
+
+/** the number of shmup::hooks_turn handlers present at startup; more of them mean that some simulation is running */
+int base_turn_hooks;
+
+bool frame_in_range(int i) {
+  if(i < min_frame || i > max_frame) return false;
+  return i >= noframes * 1ll * shard_id / shard_count && i < noframes * (shard_id+1ll) / shard_count;
+  }
+
+/** frames before the shard which a sequential render would draw; they are stepped through without drawing,
+ *  since anims::apply() moves by the time since the last frame, and these steps do not add up */
+bool frame_before_shard(int i) {
+  if(i < min_frame || i > max_frame) return false;
+  return i < noframes * 1ll * shard_id / shard_count;
+  }
+
+/** returns why the frames of the animation may depend on the earlier frames, or "" if they can be rendered independently */
+EX string sequential_reason() {
+  if(shmup::on) return "the game is in shmup mode";
+  if(cheater && numturns) return "monsters move during the animation";
+  if(clearup) return "the animation clears the walls";
+  if(shmup::hooks_turn.size() > base_turn_hooks) return "a simulation is running";
+  return "";
+  }
+
+#if CAP_ANIM_PROCESSES
+/** render the animation in anim_processes processes; raw video frames are collected and written in order */
+bool record_animation_processes(const reaction_t& content) {
+  string why = sequential_reason();
+  if(why != "") {
+    println(hlog, "cannot render the animation in parallel: ", why);
+    return false;
+    }
+  if(vid.usingGL) {
+    println(hlog, "cannot render the animation in parallel processes with OpenGL, use -animrecord-shard instead");
+    return false;
+    }
+  int n = anim_processes;
+  bool raw = shot::format == shot::screenshot_format::rawfile;
+
+  array<int, 2> tab;
+  if(pipe(&tab[0])) {
+    addMessage(format("Error: %s", strerror(errno)));
+    return false;
+    }
+
+  int total = 0;
+  for(int i=0; i<noframes; i++) if(frame_in_range(i)) total++;
+
+  vector<int> pids;
+  vector<string> rawnames;
+  for(int k=0; k<n; k++) {
+    string rawname = raw ? "/tmp/hyper-" + its(getpid()) + "-" + its(k) + ".raw" : "";
+    rawnames.push_back(rawname);
+    int pid = fork();
+    if(pid == 0) {
+      close(tab[0]);
+      progress_fd = tab[1];
+      shard_id = shard_id * n + k;
+      shard_count = shard_count * n;
+      FILE *f = nullptr;
+      if(raw) {
+        f = fopen(rawname.c_str(), "wb");
+        if(!f) _exit(1);
+        shot::rawfile_handle = fileno(f);
+        }
+      bool ok = record_animation_of(content);
+      if(f) fclose(f);
+      fflush(stdout);
+      _exit(ok ? 0 : 1);
+      }
+    if(pid < 0) {
+      println(hlog, "fork failed: ", strerror(errno));
+      break;
+      }
+    pids.push_back(pid);
+    }
+  close(tab[1]);
+
+  int done = 0, frame;
+  while(read(tab[0], &frame, sizeof(frame)) == sizeof(frame)) {
+    done++;
+    printf("%d/%d (frame %d/%d)\n", done, total, frame, noframes);
+    }
+  close(tab[0]);
+
+  bool ok = isize(pids) == n;
+  for(int pid: pids) {
+    int status;
+    if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) ok = false;
+    }
+
+  for(int k=0; k<isize(pids); k++) if(raw) {
+    FILE *f = fopen(rawnames[k].c_str(), "rb");
+    if(!f) { ok = false; continue; }
+    vector<char> buf(1<<20);
+    while(true) {
+      size_t q = fread(&buf[0], 1, buf.size(), f);
+      if(!q) break;
+      ignore(write(shot::rawfile_handle, &buf[0], q));
+      }
+    fclose(f);
+    remove(rawnames[k].c_str());
+    }
+
+  if(!ok) println(hlog, "some of the rendering processes have failed");
+  lastticks = ticks = SDL_GetTicks();
+  return ok;
+  }
+#endif
+
 EX bool record_animation_of(reaction_t content) {
+  #if CAP_ANIM_PROCESSES
+  if(anim_processes > 1 && progress_fd < 0) return record_animation_processes(content);
+  #endif
+  if(shard_count > 1 && progress_fd < 0) {
+    string why = sequential_reason();
+    if(why != "") {
+      println(hlog, "cannot render a part of the animation: ", why);
+      return false;
+      }
+    }
   lastticks = 0;
   ticks = 0;
   int oldturn = -1;
+  exp_program time_program;
+  if(time_formula != "-") {
+    try {
+      time_program = compile_formula(time_formula);
+      }
+    catch(hr_parse_exception& e) {
+      println(hlog, "warning: failed to parse time_formula, ", e.s);
+      }
+    }
+  shot::start_frame_writer();
+  finalizer fw(shot::finish_frame_writer);
   for(int i=0; i<noframes; i++) {
-    if(i < min_frame || i > max_frame) continue;
-    printf("%d/%d\n", i, noframes);
+    bool draw = frame_in_range(i);
+    if(!draw && !frame_before_shard(i)) continue;
+    if(draw && progress_fd < 0) printf("%d/%d\n", i, noframes);
     callhooks(hooks_record_anim, i, noframes);
     int newticks = i * period / noframes;
-    if(time_formula != "-") {
+    if(time_program.compiled()) {
       dynamicval<int> t(ticks, newticks);
-      exp_parser ep;
-      ep.s = time_formula;
       try {
-        newticks = ep.iparse();
+        newticks = time_program.ievaluate();
         }
       catch(hr_parse_exception& e) {
         println(hlog, "warning: failed to parse time_formula, ", e.s);
@@ -1429,11 +1674,18 @@ EX bool record_animation_of(reaction_t content) {
       history::phase -= history::extra_line_steps;
       history::movetophase();
       }
+    if(!draw) {
+      anims::apply();
+      anims::rollback();
+      continue;
+      }
     
     char buf[1000];
     snprintf(buf, 1000, animfile.c_str(), i);
     shot::take(buf, content);
+    if(progress_fd >= 0) ignore(write(progress_fd, &i, sizeof(i)));
     }
+  shot::finish_frame_writer();
   lastticks = ticks = SDL_GetTicks();
   return true;
   }
@@ -1771,6 +2023,16 @@ int readArgs() {
     shift(); min_frame = argi();
     shift(); max_frame = argi();
     }
+  else if(argis("-animrecord-shard")) {
+    PHASEFROM(2); shift();
+    if(sscanf(argcs(), "%d/%d", &shard_id, &shard_count) != 2 || shard_count < 1 || shard_id < 0 || shard_id >= shard_count)
+      throw hr_exception("-animrecord-shard: expected k/n with 0 <= k < n");
+    }
+  #if CAP_ANIM_PROCESSES
+  else if(argis("-animprocesses")) {
+    PHASEFROM(2); shift(); anim_processes = argi();
+    }
+  #endif
 #endif
 #if CAP_VIDEO
   else if(argis("-animvideo")) {
@@ -1844,6 +2106,9 @@ int readArgs() {
 #endif
 
 auto animhook = addHook(hooks_frame, 100, display_animation)
+  #if CAP_FILES && CAP_SHOT
+  + addHook(hooks_initialize, 100, [] { base_turn_hooks = shmup::hooks_turn.size(); })
+  #endif
   #if CAP_COMMANDLINE
   + addHook(hooks_args, 100, readArgs)
   #endif
@@ -64,6 +64,8 @@ struct monster {
   int split_owner;  ///< in splitscreen mode, which player handles this
   int split_tick;   ///< in which tick was split_owner computed
 
+  int intent;       ///< index in shmup::intents computed for this tick, or -1
+
   void reset() {
     nextshot = 0;
     stunoff = 0; blowoff = 0; fragoff = 0; footphase = 0;
@@ -73,7 +75,7 @@ struct monster {
 
   monster() {
     reset();
-    refs = 1; split_tick = -1; split_owner = -1;
+    refs = 1; split_tick = -1; split_owner = -1; intent = -1;
     no_targetting = false;
     dead = false; inBoat = false; parent = NULL;
     }
@@ -103,6 +105,117 @@ struct monster {
     }
 
   };  
+
+/** the monsters stored in a cell, in the order they were stored; usually few, so the first ones are kept inline */
+struct monster_list {
+  static const int inline_qty = 4;
+  monster *inl[inline_qty];
+  int n = 0;
+  vector<monster*> more;
+  monster **begin() { return more.empty() ? inl : more.data(); }
+  monster **end() { return begin() + n; }
+  void push_back(monster *m) {
+    if(more.empty() && n < inline_qty) { inl[n++] = m; return; }
+    if(more.empty()) more.assign(inl, inl+n);
+    more.push_back(m); n++;
+    }
+  void clear() { n = 0; more.clear(); }
+  };
+
+/** Inactive monsters, by the cell they are based in. An open-addressing hash table which gives
+ *  indices into a list of cells kept in the order they were first used, so that iterating
+ *  over all the monsters does not depend on the memory addresses. Emptying a cell keeps its
+ *  place; the list is compacted when most cells are empty.
+ */
+struct monster_map {
+  struct bucket {
+    cell *c;
+    monster_list ms;
+    };
+  vector<bucket> buckets;
+  vector<int> slots;
+  int qty = 0, nonempty = 0;
+
+  static size_t hash(cell *c) { return size_t((uintptr_t(c) >> 4) * 0x9E3779B97F4A7C15ull); }
+
+  /** the slot for c, either containing c or empty */
+  int find_slot(cell *c) const {
+    int mask = isize(slots) - 1;
+    int i = hash(c) & mask;
+    while(slots[i] >= 0 && buckets[slots[i]].c != c) i = (i+1) & mask;
+    return i;
+    }
+
+  void rehash(int size) {
+    slots.assign(size, -1);
+    for(int b=0; b<isize(buckets); b++) slots[find_slot(buckets[b].c)] = b;
+    }
+
+  bucket *find(cell *c) {
+    if(slots.empty()) return nullptr;
+    int i = slots[find_slot(c)];
+    return i >= 0 ? &buckets[i] : nullptr;
+    }
+
+  void insert(cell *c, monster *m) {
+    if(2 * (isize(buckets)+1) > isize(slots)) rehash(max(16, 2 * isize(slots)));
+    int& i = slots[find_slot(c)];
+    if(i < 0) { i = isize(buckets); buckets.emplace_back(); buckets.back().c = c; }
+    auto& b = buckets[i];
+    if(!b.ms.n) nonempty++;
+    b.ms.push_back(m);
+    qty++;
+    }
+
+  /** the monsters in c; invalidated by insert */
+  span_of<monster*> at(cell *c) {
+    auto b = find(c);
+    if(!b) return span_of<monster*>{nullptr, nullptr};
+    return span_of<monster*>{b->ms.begin(), b->ms.end()};
+    }
+
+  /** remove the monsters in c, appending them to v */
+  void take(cell *c, vector<monster*>& v) {
+    auto b = find(c);
+    if(!b || !b->ms.n) return;
+    for(monster *m: b->ms) v.push_back(m);
+    qty -= b->ms.n;
+    b->ms.clear();
+    nonempty--;
+    if(isize(buckets) > 64 && 4 * nonempty < isize(buckets)) compact();
+    }
+
+  /** drop the empty cells */
+  void compact() {
+    int j = 0;
+    for(int i=0; i<isize(buckets); i++) if(buckets[i].ms.n) {
+      if(i != j) buckets[j] = std::move(buckets[i]);
+      j++;
+      }
+    buckets.resize(j);
+    rehash(isize(slots));
+    }
+
+  /** all the monsters, in a deterministic order */
+  template<class T> void for_each(const T& f) {
+    for(auto& b: buckets) for(monster *m: b.ms) f(m);
+    }
+
+  int size() const { return qty; }
+
+  void clear() { buckets.clear(); slots.clear(); qty = nonempty = 0; }
+
+  /** store every monster again at its base, e.g. after they have been moved externally */
+  void rebase_all() {
+    static vector<monster*> all;
+    all.clear();
+    for_each([] (monster *m) { all.push_back(m); });
+    for(auto& b: buckets) b.ms.clear();
+    qty = nonempty = 0;
+    for(monster *m: all) insert(m->base, m);
+    compact();
+    }
+  };
 #endif
 
 using namespace multi;
@@ -118,32 +231,24 @@ EX eLand delayed_safety_land;
 
 bool lastdead = false;
 
-EX multimap<cell*, monster*> monstersAt;
-
-#if HDR
-typedef multimap<cell*, monster*>::iterator mit;
-#endif
+EX monster_map monstersAt;
 
 vector<monster*> active, nonvirtual, additional;
 
-cell *findbaseAround(shiftpoint p, cell *around, int maxsteps) {
-
-  if(fake::split()) {
-    auto p0 = inverse_shift(ggmatrix(around), p);
-    virtualRebase(around, p0);
-    return around;
-    }
-
+/** walk from around towards p; matrix_of(c) gives the matrix of c, or NULL to give up (then NULL is returned) */
+template<class T> cell *walk_towards(shiftpoint p, cell *around, int maxsteps, const T& matrix_of) {
   cell *best = around;
-  shiftmatrix T = ggmatrix(around);
-  horo_distance d0(p, T);
+  const shiftmatrix *M = matrix_of(around);
+  if(!M) return nullptr;
+  horo_distance d0(p, *M);
 
   for(int k=0; k<maxsteps; k++) {
     for(int i=0; i<around->type; i++) {
       cell *c2 = around->move(i);
       if(c2) {
-        shiftmatrix U = ggmatrix(c2);
-        horo_distance d1(p, U);
+        const shiftmatrix *U = matrix_of(c2);
+        if(!U) return nullptr;
+        horo_distance d1(p, *U);
         if(d1 < d0) { best = c2; d0 = d1; }
         }
       }
@@ -153,6 +258,26 @@ cell *findbaseAround(shiftpoint p, cell *around, int maxsteps) {
   return around;
   }
 
+shiftmatrix *ggmatrix_ptr(cell *c) { return &ggmatrix(c); }
+
+/** like ggmatrix, but does not compute the missing matrices, so that it can be called from several threads */
+const shiftmatrix *known_gmatrix(cell *c) {
+  auto it = gmatrix.find(c);
+  if(it == gmatrix.end() || it->second[LDIM][LDIM] == 0) return nullptr;
+  return &it->second;
+  }
+
+cell *findbaseAround(shiftpoint p, cell *around, int maxsteps) {
+
+  if(fake::split()) {
+    auto p0 = inverse_shift(ggmatrix(around), p);
+    virtualRebase(around, p0);
+    return around;
+    }
+
+  return walk_towards(p, around, maxsteps, ggmatrix_ptr);
+  }
+
 cell *findbaseAround(const shiftmatrix& H, cell *around, int maxsteps) {
   return findbaseAround(tC0(H), around, maxsteps);
   }
@@ -163,12 +288,14 @@ cell *findbaseAround(const shiftmatrix& H, cell *around, int maxsteps) {
   } */
 
 void monster::store() {
-  monstersAt.insert(make_pair(base, this));
+  monstersAt.insert(base, this);
   }
 
+/* uses find rather than operator[], since find_patterns calls this from several threads */
 void monster::findpat() {
-  isVirtual = !gmatrix.count(base) || invalid_matrix(gmatrix[base].T);
-  if(!isVirtual) pat = gmatrix[base] * at;
+  auto it = gmatrix.find(base);
+  isVirtual = it == gmatrix.end() || invalid_matrix(it->second.T);
+  if(!isVirtual) pat = it->second * at;
   else pat = shiftless(at);
   }
 
@@ -1923,6 +2050,91 @@ EX bool dragonbreath(cell *dragon) {
   return true;
   }
 
+#if CAP_THREAD
+/** the number of parts the read-only phases of turn() are split into, computed in the thread pool (0 = one per thread) */
+EX int threads = 1;
+/** ticks with fewer active monsters are computed in the main thread */
+EX int parallel_threshold = 4096;
+#endif
+
+/** call f(from, to) for the chunks of [0, qty), in the thread pool if there are enough of them */
+void for_chunks(int qty, const std::function<void(int, int)>& f) {
+  #if CAP_THREAD
+  int nt = threads ? threads : tasks::size() + 1;
+  if(nt > 1 && qty >= parallel_threshold) {
+    tasks::parallel_for(0, qty, (qty + nt - 1) / nt, f);
+    return;
+    }
+  #endif
+  f(0, qty);
+  }
+
+/** The first phase of turn(): find where the active monsters are in the current frame.
+ *  This reads only gmatrix and the monster itself, so the monsters can be split between threads. */
+void find_patterns() {
+  for_chunks(isize(active), [] (int from, int to) { for(int i=from; i<to; i++) active[i]->findpat(); });
+  }
+
+#if HDR
+/** where an inertia-based monster will go in this tick, computed by find_intents */
+struct monster_intent {
+  shiftmatrix pat;    ///< the state this has been computed from
+  transmatrix ori;
+  hyperpoint inertia;
+  cell *base;
+  shiftmatrix nat;    ///< the position after the move
+  cell *c2;           ///< the new base cell, NULL if it has to be found in moveMonster
+  int crash;          ///< the last player it crashes into, or -1
+  };
+#endif
+
+vector<monster_intent> intents;
+
+/** compute the moves of the inertia-based monsters in find_intents; if false, moveMonster computes them all, as before (-shmup-intents) */
+EX bool use_intents = true;
+
+template<class T> bool same_bits(const T& a, const T& b) { return memcmp(&a, &b, sizeof(T)) == 0; }
+
+/** The intent phase of turn(): compute the moves of the inertia-based monsters (Space Rocks and
+ *  RogueViz vertices), which do not depend on the other monsters. This reads only the state after
+ *  the players and missiles have moved, and writes only the intent of each monster, so the monsters
+ *  are split between threads. moveMonster applies the intent in the main thread, in the usual order,
+ *  if the monster has not changed since; otherwise it computes the move itself, in the same way.
+ *  Either way the result does not depend on the number of threads. Not used in hybrid geometries,
+ *  where these computations switch the current geometry. */
+void find_intents(int delta) {
+  if(!use_intents) {
+    for(monster *m: nonvirtual) m->intent = -1;
+    return;
+    }
+  intents.resize(isize(nonvirtual));
+  for_chunks(isize(nonvirtual), [delta] (int from, int to) {
+    for(int i=from; i<to; i++) {
+      monster *m = nonvirtual[i];
+      m->intent = -1;
+      if(!among(m->type, moAsteroid, moRogueviz) || fake::split() || hybri) continue;
+      auto& I = intents[i];
+      I.pat = m->pat; I.ori = m->ori; I.inertia = m->inertia; I.base = m->base;
+      I.nat = m->pat;
+      I.nat.T = parallel_transport(I.nat.T, m->ori, m->inertia * delta);
+      I.crash = -1;
+      for(int p=0; p<players; p++) if(pc[p] && hdist(tC0(pc[p]->pat), tC0(m->pat)) < collision_distance(pc[p], m))
+        I.crash = p;
+      I.c2 = walk_towards(tC0(I.nat), m->base, 1, known_gmatrix);
+      m->intent = i;
+      }
+    });
+  }
+
+/** the intent computed for m in this tick, if the state it was computed from is still current */
+monster_intent *current_intent(monster *m, const shiftmatrix& nat) {
+  if(m->intent < 0) return nullptr;
+  auto& I = intents[m->intent];
+  m->intent = -1;
+  if(!same_bits(I.pat, nat) || !same_bits(I.pat, m->pat) || !same_bits(I.ori, m->ori) || !same_bits(I.inertia, m->inertia) || I.base != m->base) return nullptr;
+  return &I;
+  }
+
 #define CHARGING (-777)
 #define BULLSTUN (1500)
 
@@ -2188,6 +2400,8 @@ void moveMonster(monster *m, int delta) {
   
   shiftmatrix nat0 = nat;
   
+  monster_intent *I = inertia_based ? current_intent(m, nat) : nullptr;
+
   igo_retry:
   
   if(igo == IGO && peace::on) 
@@ -2205,7 +2419,8 @@ void moveMonster(monster *m, int delta) {
   
   if(inertia_based) {
     if(igo) return;
-    nat.T = parallel_transport(nat.T, m->ori, m->inertia * delta);
+    if(I) nat = I->nat;
+    else nat.T = parallel_transport(nat.T, m->ori, m->inertia * delta);
     }
   else if(WDIM == 3 && igo) {
     ld fspin = rand() % 1000;  
@@ -2235,7 +2450,10 @@ void moveMonster(monster *m, int delta) {
     if(d < SCALE2 * 0.1) crashintomon = m2;
     }
   
-  if(inertia_based) for(int i=0; i<players; i++) if(pc[i] && hdist(tC0(pc[i]->pat), tC0(m->pat)) < collision_distance(pc[i], m))
+  if(inertia_based && I) {
+    if(I->crash >= 0) crashintomon = pc[I->crash];
+    }
+  else if(inertia_based) for(int i=0; i<players; i++) if(pc[i] && hdist(tC0(pc[i]->pat), tC0(m->pat)) < collision_distance(pc[i], m))
     crashintomon = pc[i];
   
   if(!peace::on) 
@@ -2265,7 +2483,7 @@ void moveMonster(monster *m, int delta) {
   
   if(crashintomon && !inertia_based) { igo++; goto igo_retry; }
 
-  cell *c2 = m->findbase(nat, 1);
+  cell *c2 = I && I->c2 ? I->c2 : m->findbase(nat, 1);
   if(reflectflag & P_MIRRORWALL) reflect(c2, m->base, nat);
 
   if(m->type == moButterfly && !passable_for(m->type, c2, m->base, P_CHAIN | reflectflag)) {
@@ -2516,15 +2734,7 @@ void moveMonster(monster *m, int delta) {
   }
 
 void activateMonstersAt(cell *c) {
-  pair<mit, mit> p = 
-    monstersAt.equal_range(c);
-  for(mit it = p.first; it != p.second;) {
-    mit itplus = it;
-    itplus++;
-    active.push_back(it->second);
-    monstersAt.erase(it);
-    it = itplus;
-    }
+  monstersAt.take(c, active);
   if(c->monst && isMimic(c->monst)) c->monst = moNone;
   // mimics are awakened by awakenMimics
   if(c->monst && !isIvy(c) && !isWorm(c) && !isMutantIvy(c) && !isKraken(c->monst) && c->monst != moPrincess && c->monst != moHunterGuard && !isDie(c->monst)) {
@@ -2548,15 +2758,7 @@ void activateMonstersAt(cell *c) {
   }
 
 EX void fixStorage() {
-
-  vector<monster*> restore;
-
-  for(auto it = monstersAt.begin(); it != monstersAt.end(); it++) 
-    restore.push_back(it->second);
-
-  monstersAt.clear();
-
-  for(monster *m: restore) m->store();
+  monstersAt.rebase_all();
   }
 
 EX hookset<bool(int)> hooks_turn;
@@ -2627,9 +2829,9 @@ EX void turn(int delta) {
   
   for(int i=0; i<motypes; i++) exists[i] = false;
 
+  find_patterns();
   nonvirtual.clear();
   for(monster *m: active) {
-    m->findpat();
     if(m->isVirtual) continue;
     else nonvirtual.push_back(m);
     exists[movegroup(m->type)] = true;
@@ -2656,6 +2858,8 @@ EX void turn(int delta) {
       moveMimic(m);
     }
 
+  find_intents(delta);
+
   for(int t=1; t<motypes; t++) if(exists[t]) {
   
     pathdata pd(1);
@@ -2878,20 +3082,15 @@ EX void init() {
   }
 
 EX bool boatAt(cell *c) {
-  pair<mit, mit> p = 
-    monstersAt.equal_range(c);
-  for(mit it = p.first; it != p.second; it++) {
-    monster* m = it->second;
+  for(monster *m: monstersAt.at(c))
     if(m->inBoat) return true;
-    }
   return false;
   }
 
 EX hookset<bool(const shiftmatrix&, cell*, shmup::monster*)> hooks_draw;
 
 EX void clearMonsters() {
-  for(mit it = monstersAt.begin(); it != monstersAt.end(); it++)
-    delete(it->second);
+  monstersAt.for_each([] (monster *m) { delete m; });
   for(monster *m: active) m->remove_reference();
   mousetarget = NULL;
   lmousetarget = NULL;
@@ -2963,14 +3162,13 @@ EX void addShmupHelp(string& out) {
 auto hooks = addHook(hooks_clearmemory, 0, shmup::clearMemory) +
   addHook(hooks_gamedata, 0, shmup::gamedata) +
   addHook(hooks_removecells, 0, [] () {
-    for(mit it = monstersAt.begin(); it != monstersAt.end();) {
-      if(is_cell_removed(it->first)) {
-        monstersAt.insert(make_pair(nullptr, it->second));
-        auto it0 = it; it++;
-        monstersAt.erase(it0);
-        }
-      else it++;
-      }
+    vector<cell*> removed;
+    for(auto& b: monstersAt.buckets)
+      if(b.c && b.ms.n && is_cell_removed(b.c)) removed.push_back(b.c);
+    vector<monster*> lost;
+    for(cell *c: removed) monstersAt.take(c, lost);
+    for(monster *m: lost) monstersAt.insert(nullptr, m);
+    monstersAt.compact();
     });
 
 EX void switch_shmup() { 
@@ -2982,7 +3180,7 @@ EX void switch_shmup() {
 
 #if MAXMDIM >= 4
 auto hooksw = addHook(hooks_swapdim, 100, [] {
-  for(auto& p: monstersAt) swapmatrix(p.second->at);
+  monstersAt.for_each([] (monster *m) { swapmatrix(m->at); });
   });
 #endif
     
@@ -2992,16 +3190,14 @@ bool celldrawer::draw_shmup_monster() {
   using namespace shmup;
   #if CAP_SHAPES
 
-  pair<mit, mit> p = 
-    monstersAt.equal_range(c);
+  auto p = monstersAt.at(c);
     
-  if(p.first == p.second) return false;
+  if(p.empty()) return false;
   ld zlev = -geom3::factor_to_lev(zlevel(tC0(Vd.T)));
    
   vector<monster*> monsters;
 
-  for(mit it = p.first; it != p.second; it++) {
-    monster* m = it->second;
+  for(monster *m: p) {
     if(c != m->base) continue; // may happen in RogueViz Collatz
     m->pat = ggmatrix(m->base) * m->at;
     shiftmatrix view = V * m->at;
@@ -197,6 +197,10 @@
 #define CAP_VIDEO (CAP_SHOT && ISLINUX && CAP_SDL)
 #endif
 
+#ifndef CAP_ANIM_PROCESSES
+#define CAP_ANIM_PROCESSES (CAP_SHOT && (ISLINUX || ISMAC))
+#endif
+
 #ifndef MAXMDIM
 #define MAXMDIM 4
 #endif
@@ -319,6 +323,18 @@
 #define CAP_ACHIEVE ISSTEAM
 #endif
 
+#ifndef CAP_MMAP
+#define CAP_MMAP (CAP_FILES && !ISWINDOWS && !ISWEB)
+#endif
+
+#ifndef CAP_SIMD
+#if defined(__SSE2__) || defined(_M_X64)
+#define CAP_SIMD 1
+#else
+#define CAP_SIMD 0
+#endif
+#endif
+
 #ifndef CAP_SHMUP_GOOD
 #define CAP_SHMUP_GOOD (!ISMOBWEB)
 #endif
@@ -533,7 +549,7 @@ typedef unsigned GLuint;
 #endif
 #endif
 
-#if CAP_VIDEO
+#if CAP_VIDEO || CAP_ANIM_PROCESSES
 #include <sys/wait.h>
 #endif
 
@@ -560,6 +576,11 @@ typedef unsigned GLuint;
 #include <mutex>
 #include <condition_variable>
 #endif
+#include <atomic>
+#endif
+
+#if CAP_PROFILING
+#include <chrono>
 #endif
 
 #include <stdint.h>
@@ -588,6 +609,14 @@ typedef unsigned GLuint;
 #include <sys/time.h>
 #endif
 
+#if CAP_MMAP
+#include <sys/mman.h>
+#endif
+
+#if CAP_SIMD
+#include <emmintrin.h>
+#endif
+
 #ifdef BACKTRACE
 #include <execinfo.h>
 #endif
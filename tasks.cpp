@@ -0,0 +1,336 @@
+// Hyperbolic Rogue -- thread pool
+// Copyright (C) 2011-2021 Zeno Rogue, see 'hyper.cpp' for details
+
+/** \file tasks.cpp
+ *  \brief a persistent thread pool for the CPU-heavy loops
+ *
+ *  Compiled in only with CAP_THREAD. tasks::parallel_for(from, to, grain, f) calls f(a, b) for
+ *  subranges [a, b) of [from, to) and returns when all of them are done; tasks::async(f)
+ *  computes f in the background and returns a tasks::future.
+ *
+ *  Every worker thread has its own deque of tasks. It takes the newest task from its own deque,
+ *  and steals the oldest one from the other deques when its own deque is empty. Threads which
+ *  wait for a result (in parallel_for or future::get) run the waiting tasks in the meantime,
+ *  so these can be nested, and they work even if all the workers are busy.
+ *
+ *  The tasks which have not started yet are cancelled on hooks_clearmemory, unless they have
+ *  been submitted as persistent; the running tasks can check tasks::cancelled() to stop early.
+ *  The persistent tasks are only run by the workers, never by the waiting threads.
+ *
+ *  The pool is meant for CPU work. Jobs which block for a long time (e.g., waiting for the user,
+ *  as the fieldpattern discoverer does) should have their own std::thread instead, since they
+ *  would keep a worker busy.
+ */
+
+#include "hyper.h"
+namespace hr {
+
+#if CAP_THREAD
+EX namespace tasks {
+
+#if HDR
+struct task {
+  std::function<void()> run;
+  /** called instead of run if the task is cancelled before it starts */
+  std::function<void()> cancel;
+  /** the generation in which the task has been submitted; -1 for persistent tasks */
+  int generation;
+  };
+#endif
+
+/** the number of worker threads (0 = one less than the hardware concurrency, but at least one); must be set before the first use */
+EX int threads = 0;
+
+struct task_pool {
+  struct queue {
+    std::mutex lock;
+    std::deque<task> tasks;
+    };
+
+  vector<std::thread> workers;
+  vector<std::shared_ptr<queue>> queues;
+  std::mutex lock;
+  /** the workers wait on wake for new tasks; the threads waiting for results wait on done */
+  std::condition_variable wake, done;
+  std::atomic<int> pending, generation;
+  /** how many of the pending tasks are persistent */
+  std::atomic<int> pending_persistent;
+  int next_queue;
+  bool stopping;
+
+  /** the index of the current worker thread, -1 in other threads */
+  static thread_local int index;
+  /** the generation of the task running in the current thread */
+  static thread_local int running_generation;
+
+  task_pool() : pending(0), generation(0), pending_persistent(0), next_queue(0), stopping(false) {}
+
+  void start() {
+    std::unique_lock<std::mutex> lk(lock);
+    if(!workers.empty()) return;
+    int n = threads;
+    if(n <= 0) n = max(int(std::thread::hardware_concurrency()) - 1, 1);
+    for(int i=0; i<n; i++) queues.emplace_back(std::make_shared<queue>());
+    for(int i=0; i<n; i++) workers.emplace_back([this, i] { work(i); });
+    }
+
+  int size() { start(); return isize(workers); }
+
+  void notify() {
+    if(1) { std::unique_lock<std::mutex> lk(lock); }
+    wake.notify_one();
+    done.notify_all();
+    }
+
+  void submit(task t) {
+    start();
+    int i = index;
+    if(i < 0) {
+      std::unique_lock<std::mutex> lk(lock);
+      i = next_queue++ % isize(queues);
+      }
+    if(1) {
+      std::unique_lock<std::mutex> lk(queues[i]->lock);
+      if(t.generation < 0) pending_persistent++;
+      queues[i]->tasks.push_back(std::move(t));
+      }
+    pending++;
+    notify();
+    }
+
+  /** the number of pending tasks which may be taken */
+  int available(bool persistent) { return persistent ? int(pending) : pending - pending_persistent; }
+
+  /* move the task at position it of q to t */
+  void take_from(std::deque<task>& q, std::deque<task>::iterator it, task& t) {
+    t = std::move(*it); q.erase(it);
+    if(t.generation < 0) pending_persistent--;
+    }
+
+  /* take the newest task from our own queue, or steal the oldest task from another queue;
+   * the persistent tasks are skipped unless `persistent` */
+  bool take(task& t, bool persistent) {
+    if(!available(persistent)) return false;
+    int n = isize(queues);
+    if(index >= 0) {
+      auto& q = *queues[index];
+      std::unique_lock<std::mutex> lk(q.lock);
+      for(auto it = q.tasks.end(); it != q.tasks.begin(); ) {
+        --it;
+        if(persistent || it->generation >= 0) { take_from(q.tasks, it, t); return true; }
+        }
+      }
+    int start = index >= 0 ? index + 1 : 0;
+    for(int k=0; k<n; k++) {
+      auto& q = *queues[(start + k) % n];
+      std::unique_lock<std::mutex> lk(q.lock);
+      for(auto it = q.tasks.begin(); it != q.tasks.end(); it++)
+        if(persistent || it->generation >= 0) { take_from(q.tasks, it, t); return true; }
+      }
+    return false;
+    }
+
+  void execute(task& t) {
+    if(t.generation >= 0 && t.generation != generation) {
+      if(t.cancel) t.cancel();
+      }
+    else {
+      int g = running_generation;
+      running_generation = t.generation;
+      t.run();
+      running_generation = g;
+      }
+    }
+
+  bool run_one(bool persistent) {
+    task t;
+    if(!take(t, persistent)) return false;
+    pending--;
+    execute(t);
+    if(1) { std::unique_lock<std::mutex> lk(lock); }
+    done.notify_all();
+    return true;
+    }
+
+  void work(int i) {
+    index = i;
+    while(true) {
+      if(run_one(true)) continue;
+      std::unique_lock<std::mutex> lk(lock);
+      wake.wait(lk, [this] { return stopping || pending > 0; });
+      if(stopping) return;
+      }
+    }
+
+  /* a persistent task may run for a long time, so the waiting threads do not take them */
+  void help_until(const std::function<bool()>& ready) {
+    while(!ready()) {
+      if(run_one(false)) continue;
+      std::unique_lock<std::mutex> lk(lock);
+      done.wait(lk, [this, &ready] { return available(false) > 0 || ready(); });
+      }
+    }
+
+  void cancel_all() {
+    generation++;
+    vector<task> cancelled;
+    for(auto& q: queues) {
+      std::unique_lock<std::mutex> lk(q->lock);
+      std::deque<task> keep;
+      for(auto& t: q->tasks)
+        if(t.generation < 0) keep.push_back(std::move(t));
+        else cancelled.push_back(std::move(t));
+      q->tasks.swap(keep);
+      }
+    pending -= isize(cancelled);
+    for(auto& t: cancelled) if(t.cancel) t.cancel();
+    notify();
+    }
+
+  ~task_pool() {
+    cancel_all();
+    if(1) {
+      std::unique_lock<std::mutex> lk(lock);
+      stopping = true;
+      }
+    wake.notify_all();
+    for(auto& w: workers) w.join();
+    }
+  };
+
+thread_local int task_pool::index = -1;
+thread_local int task_pool::running_generation = -1;
+
+task_pool& pool() {
+  static task_pool p;
+  return p;
+  }
+
+/** the number of worker threads */
+EX int size() { return pool().size(); }
+
+/** run t in a worker thread */
+EX void submit(const task& t) { pool().submit(t); }
+
+/** the current generation, for task::generation */
+EX int generation() { return pool().generation; }
+
+/** run the waiting tasks until ready() is true */
+EX void help_until(const std::function<bool()>& ready) { pool().help_until(ready); }
+
+/** has the task running in the current thread been cancelled? */
+EX bool cancelled() {
+  int g = task_pool::running_generation;
+  return g >= 0 && g != pool().generation;
+  }
+
+/** cancel all the tasks which have not started yet, except the persistent ones */
+EX void cancel_all() { pool().cancel_all(); }
+
+/** call f(a, b) for consecutive subranges [a, b) of [from, to), of length grain (0 = choose automatically),
+ *  in parallel; returns when all of them are done. If f throws, the first exception is rethrown. */
+EX void parallel_for(int from, int to, int grain, const std::function<void(int, int)>& f) {
+  if(to <= from) return;
+  int n = size();
+  if(grain <= 0) grain = max((to - from) / (8 * (n+1)), 1);
+  int chunks = (to - from + grain - 1) / grain;
+  if(chunks == 1) { f(from, to); return; }
+
+  /* the helpers may start after everything is done, so they only touch f while there are chunks left */
+  struct state {
+    std::atomic<int> next, finished;
+    std::mutex lock;
+    std::exception_ptr error;
+    state() : next(0), finished(0) {}
+    };
+  auto s = std::make_shared<state>();
+  const std::function<void(int, int)> *pf = &f;
+  auto run_chunks = [s, pf, from, to, grain, chunks] {
+    int k;
+    while((k = s->next++) < chunks) {
+      try {
+        (*pf)(from + k * grain, min(to, from + (k+1) * grain));
+        }
+      catch(...) {
+        std::unique_lock<std::mutex> lk(s->lock);
+        if(!s->error) s->error = std::current_exception();
+        }
+      s->finished++;
+      }
+    };
+  int helpers = min(chunks - 1, n);
+  for(int i=0; i<helpers; i++) submit(task{run_chunks, nullptr, generation()});
+  run_chunks();
+  help_until([s, chunks] { return s->finished == chunks; });
+  if(s->error) std::rethrow_exception(s->error);
+  }
+
+#if HDR
+template<class T> struct future_state {
+  std::atomic<bool> ready;
+  std::exception_ptr error;
+  T value;
+  future_state() : ready(false) {}
+  template<class F> void compute(F& f) { value = f(); }
+  T result() { return value; }
+  };
+
+template<> struct future_state<void> {
+  std::atomic<bool> ready;
+  std::exception_ptr error;
+  future_state() : ready(false) {}
+  template<class F> void compute(F& f) { f(); }
+  void result() {}
+  };
+
+template<class T> struct future {
+  std::shared_ptr<future_state<T>> state;
+  bool valid() const { return !!state; }
+  bool ready() const { return state->ready; }
+  /** wait for the result, running other tasks in the meantime */
+  void wait() { auto s = state; help_until([s] { return !!s->ready; }); }
+  /** the result; rethrows the exception thrown by the task, or hr_exception if it has been cancelled */
+  T get() { wait(); if(state->error) std::rethrow_exception(state->error); return state->result(); }
+  };
+
+/** compute f() in a worker thread; persistent tasks are not cancelled on hooks_clearmemory */
+template<class F> auto async(F f, bool persistent = false) -> future<decltype(f())> {
+  typedef decltype(f()) T;
+  future<T> res;
+  auto s = res.state = std::make_shared<future_state<T>>();
+  task t;
+  t.run = [s, f] () mutable {
+    try { s->compute(f); }
+    catch(...) { s->error = std::current_exception(); }
+    s->ready = true;
+    };
+  t.cancel = [s] {
+    s->error = std::make_exception_ptr(hr_exception("task cancelled"));
+    s->ready = true;
+    };
+  t.generation = persistent ? -1 : generation();
+  submit(t);
+  return res;
+  }
+#endif
+
+#if CAP_COMMANDLINE
+int read_args() {
+  using namespace arg;
+  if(0) ;
+  else if(argis("-task-threads")) {
+    shift(); threads = argi();
+    }
+  else return 1;
+  return 0;
+  }
+
+auto ah = addHook(hooks_args, 0, read_args);
+#endif
+
+auto tasks_hooks = addHook(hooks_clearmemory, 0, cancel_all);
+
+EX }
+#endif
+
+}
@@ -91,11 +91,19 @@ struct hr_parse_exception : hr_exception {
   ~hr_parse_exception() noexcept(true) {}
   };
 
+inline ld validate_real_at(cld x, const string& where) {
+  if(kz(imag(x))) throw hr_parse_exception("expected real number but " + lalign(-1, x) + " found at " + where);
+  return real(x);
+  }
+
+/** \brief compiled code of a formula; the argument is the array of variable slots */
+typedef std::function<cld(cld*)> exp_code;
+
 struct exp_parser {
   string s;
   int at;
   int line_number, last_line;
-  exp_parser() { at = 0; line_number = 1; last_line = 0; }
+  exp_parser() { at = 0; line_number = 1; last_line = 0; slot_count = 0; }
   
   string where() { 
     if(s.find('\n')) return "(line " + its(line_number) + ", pos " + its(at-last_line) + ")";
@@ -104,6 +112,12 @@ struct exp_parser {
   
   map<string, cld> extra_params;
 
+  /** \brief variables bound to slots while compiling (innermost last); these take precedence over extra_params */
+  vector<pair<string, int>> slot_names;
+
+  /** \brief the number of slots used by the code compiled so far */
+  int slot_count;
+
   bool ok() { return at == isize(s); }
   char next(int step=0) { if(at >= isize(s)-step) return 0; else return s[at+step]; }
   
@@ -129,6 +143,20 @@ struct exp_parser {
 
   cld parse(int prio = 0);
 
+  exp_code compile(int prio = 0);
+
+  exp_code compile_real(int prio = 0);
+
+  exp_code compile_par() {
+    auto res = compile();
+    force_eat(")");
+    return res;
+    }
+
+  std::function<vector<pair<ld, ld>>(cld*)> compile_with_reps();
+
+  bool find_variable(const string& name, exp_code& res);
+
   ld rparse(int prio = 0) { return validate_real(parse(prio)); }
   int iparse(int prio = 0) { return int(floor(rparse(prio) + .5)); }
 
@@ -138,10 +166,7 @@ struct exp_parser {
     return res;
     }
 
-  ld validate_real(cld x) {
-    if(kz(imag(x))) throw hr_parse_exception("expected real number but " + lalign(-1, x) + " found at " + where());
-    return real(x);
-    }
+  ld validate_real(cld x) { return validate_real_at(x, where()); }
   
   void force_eat(const char *c) {
     skip_white();
@@ -149,6 +174,35 @@ struct exp_parser {
     }
 
   };
+
+/** \brief a formula compiled once by exp_parser::compile, to be evaluated many times
+ *
+ *  Variables are given by slot, in the order of `variables`; this is much faster than
+ *  re-parsing the formula with the values given in exp_parser::extra_params.
+ */
+struct exp_program {
+  /** \brief the names of the variables, in the order in which their values are given */
+  vector<string> variables;
+  /** \brief the position at the end of the formula, as returned by exp_parser::where() */
+  string where;
+  exp_code code;
+  /** \brief the slots: variables, followed by the ones bound by let */
+  vector<cld> slots;
+
+  bool compiled() const { return bool(code); }
+  cld evaluate() { return code(slots.data()); }
+  cld evaluate(const vector<cld>& values) {
+    for(int i=0; i<isize(values); i++) slots[i] = values[i];
+    return evaluate();
+    }
+  cld evaluate(std::initializer_list<cld> values) {
+    int i = 0;
+    for(auto& v: values) slots[i++] = v;
+    return evaluate();
+    }
+  ld revaluate() { return validate_real_at(evaluate(), where); }
+  int ievaluate() { return int(floor(revaluate() + .5)); }
+  };
 #endif
 
 void exp_parser::skip_white() {
@@ -188,279 +242,386 @@ vector<pair<ld, ld>> exp_parser::parse_with_reps() {
   return vals;
   }
 
+template<class T> exp_code exp_unary(const exp_code& a, T f) {
+  return [a, f] (cld *v) { return cld(f(a(v))); };
+  }
+
+exp_code exp_constant(cld x) {
+  return [x] (cld*) { return x; };
+  }
+
+bool exp_parser::find_variable(const string& name, exp_code& res) {
+  for(int i=isize(slot_names)-1; i>=0; i--) if(slot_names[i].first == name) {
+    int k = slot_names[i].second;
+    res = [k] (cld *v) { return v[k]; };
+    return true;
+    }
+  if(auto *p = hr::at_or_null(extra_params, name)) {
+    res = exp_constant(*p);
+    return true;
+    }
+  return false;
+  }
+
+exp_code exp_parser::compile_real(int prio) {
+  auto a = compile(prio);
+  string w = where();
+  return [a, w] (cld *v) { return cld(validate_real_at(a(v), w)); };
+  }
+
+std::function<vector<pair<ld, ld>>(cld*)> exp_parser::compile_with_reps() {
+  vector<pair<exp_code, exp_code>> parts;
+  parts.emplace_back(compile_real(0), exp_constant(1));
+  while(true) {
+    skip_white();
+    if(eat(":^")) {
+      auto rep = compile_real(0);
+      auto prev = parts.back().second;
+      parts.back().second = [prev, rep] (cld *v) { return prev(v) * rep(v); };
+      }
+    if(eat(",")) parts.emplace_back(compile_real(0), exp_constant(1));
+    else break;
+    }
+  return [parts] (cld *v) {
+    vector<pair<ld, ld>> vals;
+    for(auto& p: parts) vals.emplace_back(real(p.first(v)), real(p.second(v)));
+    return vals;
+    };
+  }
+
 cld exp_parser::parse(int prio) {
-  cld res;
+  auto code = compile(prio);
+  vector<cld> slots(slot_count);
+  return code(slots.data());
+  }
+
+/** \brief compile the formula at the current position; errors in the syntax are thrown as hr_parse_exception right away */
+exp_code exp_parser::compile(int prio) {
+  exp_code res;
   skip_white();
-  if(eat("sin(")) res = sin(parsepar());
-  else if(eat("cos(")) res = cos(parsepar());
-  else if(eat("sinh(")) res = sinh(parsepar());
-  else if(eat("cosh(")) res = cosh(parsepar());
-  else if(eat("asin(")) res = asin(parsepar());
-  else if(eat("acos(")) res = acos(parsepar());
-  else if(eat("asinh(")) res = asinh(parsepar());
-  else if(eat("acosh(")) res = acosh(parsepar());
-  else if(eat("exp(")) res = exp(parsepar());
-  else if(eat("sqrt(")) res = sqrt(parsepar());
-  else if(eat("log(")) res = log(parsepar());
-  else if(eat("tan(")) res = tan(parsepar());
-  else if(eat("tanh(")) res = tanh(parsepar());
-  else if(eat("atan(")) res = atan(parsepar());
-  else if(eat("atanh(")) res = atanh(parsepar());
-  else if(eat("abs(")) res = abs(parsepar());
-  else if(eat("re(")) res = real(parsepar());
-  else if(eat("im(")) res = imag(parsepar());
-  else if(eat("conj(")) res = std::conj(parsepar());
-  else if(eat("floor(")) res = floor(validate_real(parsepar()));
-  else if(eat("frac(")) { res = parsepar(); res = res - floor(validate_real(res)); }
-  else if(eat("to01(")) { res = parsepar(); return atan(res) / ld(M_PI) + ld(0.5); }
-  else if(eat("min(")) {
-    ld a = rparse(0);
-    while(skip_white(), eat(",")) a = min(a, rparse(0));
+  if(eat("sin(")) res = exp_unary(compile_par(), [] (cld x) { return sin(x); });
+  else if(eat("cos(")) res = exp_unary(compile_par(), [] (cld x) { return cos(x); });
+  else if(eat("sinh(")) res = exp_unary(compile_par(), [] (cld x) { return sinh(x); });
+  else if(eat("cosh(")) res = exp_unary(compile_par(), [] (cld x) { return cosh(x); });
+  else if(eat("asin(")) res = exp_unary(compile_par(), [] (cld x) { return asin(x); });
+  else if(eat("acos(")) res = exp_unary(compile_par(), [] (cld x) { return acos(x); });
+  else if(eat("asinh(")) res = exp_unary(compile_par(), [] (cld x) { return asinh(x); });
+  else if(eat("acosh(")) res = exp_unary(compile_par(), [] (cld x) { return acosh(x); });
+  else if(eat("exp(")) res = exp_unary(compile_par(), [] (cld x) { return exp(x); });
+  else if(eat("sqrt(")) res = exp_unary(compile_par(), [] (cld x) { return sqrt(x); });
+  else if(eat("log(")) res = exp_unary(compile_par(), [] (cld x) { return log(x); });
+  else if(eat("tan(")) res = exp_unary(compile_par(), [] (cld x) { return tan(x); });
+  else if(eat("tanh(")) res = exp_unary(compile_par(), [] (cld x) { return tanh(x); });
+  else if(eat("atan(")) res = exp_unary(compile_par(), [] (cld x) { return atan(x); });
+  else if(eat("atanh(")) res = exp_unary(compile_par(), [] (cld x) { return atanh(x); });
+  else if(eat("abs(")) res = exp_unary(compile_par(), [] (cld x) { return abs(x); });
+  else if(eat("re(")) res = exp_unary(compile_par(), [] (cld x) { return real(x); });
+  else if(eat("im(")) res = exp_unary(compile_par(), [] (cld x) { return imag(x); });
+  else if(eat("conj(")) res = exp_unary(compile_par(), [] (cld x) { return std::conj(x); });
+  else if(eat("floor(")) {
+    auto a = compile_par(); string w = where();
+    res = [a, w] (cld *v) { return cld(floor(validate_real_at(a(v), w))); };
+    }
+  else if(eat("frac(")) {
+    auto a = compile_par(); string w = where();
+    res = [a, w] (cld *v) { cld x = a(v); return x - floor(validate_real_at(x, w)); };
+    }
+  else if(eat("to01(")) return exp_unary(compile_par(), [] (cld x) { return atan(x) / ld(M_PI) + ld(0.5); });
+  else if(eat("min(") || eat("max(")) {
+    bool is_max = s[at-2] == 'x';
+    vector<exp_code> args = { compile_real(0) };
+    while(skip_white(), eat(",")) args.push_back(compile_real(0));
     force_eat(")");
-    res = a;
-    }
-  else if(eat("max(")) {
-    ld a = rparse(0);
-    while(skip_white(), eat(",")) a = max(a, rparse(0));
-    force_eat(")");
-    res = a;
+    res = [args, is_max] (cld *v) {
+      ld a = real(args[0](v));
+      for(int i=1; i<isize(args); i++) a = is_max ? max(a, real(args[i](v))) : min(a, real(args[i](v)));
+      return cld(a);
+      };
     }
   else if(eat("edge(")) {
-    ld a = rparse(0);
+    auto a = compile_real(0);
     force_eat(",");
-    ld b = rparse(0);
+    auto b = compile_real(0);
     force_eat(")");
-    res = edge_of_triangle_with_angles(2*M_PI/a, M_PI/b, M_PI/b);
+    res = [a, b] (cld *v) { ld ra = real(a(v)), rb = real(b(v)); return cld(edge_of_triangle_with_angles(2*M_PI/ra, M_PI/rb, M_PI/rb)); };
     }
   else if(eat("edge_angles(")) {
-    cld a = rparse(0);
+    auto a = compile_real(0);
     force_eat(",");
-    cld b = rparse(0);
+    auto b = compile_real(0);
     force_eat(",");
-    cld c = rparse(0);
+    auto c = compile_real(0);
     force_eat(")");
 
-    if (auto *angleunit = hr::at_or_null(extra_params, "angleunit")) {
-      a *= *angleunit;
-      b *= *angleunit;
-      c *= *angleunit;
-      }
+    exp_code angleunit = exp_constant(1);
+    find_variable("angleunit", angleunit);
 
-    return edge_of_triangle_with_angles(real(a), real(b), real(c));
+    return [a, b, c, angleunit] (cld *v) { 
+      cld u = angleunit(v);
+      return cld(edge_of_triangle_with_angles(real(a(v) * u), real(b(v) * u), real(c(v) * u)));
+      };
     }
   else if(eat("regradius(")) {
-    ld a = rparse(0);
+    auto a = compile_real(0);
     force_eat(",");
-    ld b = rparse(0);
+    auto b = compile_real(0);
     force_eat(")");
-    res = edge_of_triangle_with_angles(M_PI/2, M_PI/a, M_PI/b);
+    res = [a, b] (cld *v) { return cld(edge_of_triangle_with_angles(M_PI/2, M_PI/real(a(v)), M_PI/real(b(v)))); };
     }
   #if CAP_ARCM
   else if(eat("arcmedge(")) {
-    vector<pair<ld, ld>> vals = parse_with_reps();
+    auto vals = compile_with_reps();
     force_eat(")");
-    res = euclid ? 1 : arcm::compute_edgelength(vals);
-    if (auto *distunit = hr::at_or_null(extra_params, "distunit"))
-      res /= *distunit;
+    exp_code distunit = exp_constant(1);
+    find_variable("distunit", distunit);
+    res = [vals, distunit] (cld *v) { 
+      cld r = euclid ? 1 : arcm::compute_edgelength(vals(v));
+      return r / distunit(v);
+      };
     }
   else if(eat("arcmcurv(")) {
-    vector<pair<ld, ld>> vals = parse_with_reps();
+    auto vals = compile_with_reps();
     force_eat(")");
-    ld total = 0;
-    for(auto p: vals) total += p.second * (180 - 360 / p.first);
-    total = (360 - total) * degree;
-    if(abs(total) < 1e-10) total = 0;
-    res = total;
+    res = [vals] (cld *v) {
+      ld total = 0;
+      for(auto p: vals(v)) total += p.second * (180 - 360 / p.first);
+      total = (360 - total) * degree;
+      if(abs(total) < 1e-10) total = 0;
+      return cld(total);
+      };
     }
   #endif
-  else if(eat("ideal_angle(")) {
-    ld edges = rparse(0);
-    ld u = 1;
-    skip_white(); if(eat(",")) u = rparse(0);
-    force_eat(")");
-    return arb::rep_ideal(edges, u).second;
-    }
-  else if(eat("ideal_edge(")) {
-    ld edges = rparse(0);
-    ld u = 1;
-    skip_white(); if(eat(",")) u = rparse(0);
+  else if(eat("ideal_angle(") || eat("ideal_edge(")) {
+    bool edge = s[at-2] == 'e' && s[at-3] == 'g';
+    auto edges = compile_real(0);
+    exp_code u = exp_constant(1);
+    skip_white(); if(eat(",")) u = compile_real(0);
     force_eat(")");
-    return arb::rep_ideal(edges, u).first;
+    return [edges, u, edge] (cld *v) { 
+      auto p = arb::rep_ideal(real(edges(v)), real(u(v)));
+      return cld(edge ? p.first : p.second);
+      };
     }
   else if(eat("regangle(")) {
-    cld edgelen = parse(0);
-    if (auto *distunit = hr::at_or_null(extra_params, "distunit")) {
-      edgelen *= *distunit;
-      }
+    auto edgelen = compile(0);
+    exp_code distunit = exp_constant(1);
+    find_variable("distunit", distunit);
     
     force_eat(",");
-    ld edges = rparse(0);
+    auto edges = compile_real(0);
     force_eat(")");
-    ld alpha = M_PI / edges;
-    if(isinf(edges)) {
-      ld u = sqrt(cosh(validate_real(edgelen)) * 2 - 2);
-      ld a = atan2(1, u/2);
-      res = 2 * a;
-      }
-    else {
-      ld c = asin_auto(sin_auto(validate_real(edgelen)/2) / sin(alpha));
-      hyperpoint h = xpush(c) * spin(M_PI - 2*alpha) * xpush0(c);
-      ld result = 2 * atan2(h);
-      if(result < 0) result = -result;
-      while(result > 2 * M_PI) result -= 2 * M_PI;
-      if(result > M_PI) result = 2 * M_PI - result;
-      res = result;
-      }
-
-    if (auto *angleunit = hr::at_or_null(extra_params, "angleunit"))
-      res /= *angleunit;
+    string w = where();
+    exp_code angleunit = exp_constant(1);
+    bool has_angleunit = find_variable("angleunit", angleunit);
+
+    res = [edgelen, distunit, edges, w, angleunit, has_angleunit] (cld *v) {
+      ld el = validate_real_at(edgelen(v) * distunit(v), w);
+      ld ed = real(edges(v));
+      ld alpha = M_PI / ed;
+      cld res;
+      if(isinf(ed)) {
+        ld u = sqrt(cosh(el) * 2 - 2);
+        ld a = atan2(1, u/2);
+        res = 2 * a;
+        }
+      else {
+        ld c = asin_auto(sin_auto(el/2) / sin(alpha));
+        hyperpoint h = xpush(c) * spin(M_PI - 2*alpha) * xpush0(c);
+        ld result = 2 * atan2(h);
+        if(result < 0) result = -result;
+        while(result > 2 * M_PI) result -= 2 * M_PI;
+        if(result > M_PI) result = 2 * M_PI - result;
+        res = result;
+        }
+      if(has_angleunit) res /= angleunit(v);
+      return res;
+      };
     }
   else if(eat("test(")) {
-    res = parsepar();
-    println(hlog, "res = ", res, ": ", fts(real(res), 10), ",", fts(imag(res), 10));
+    auto a = compile_par();
+    res = [a] (cld *v) {
+      cld res = a(v);
+      println(hlog, "res = ", res, ": ", fts(real(res), 10), ",", fts(imag(res), 10));
+      return res;
+      };
     }
-  else if(eat("ifp(")) {
-    cld cond = parse(0);
+  else if(eat("ifp(") || eat("ifz(")) {
+    bool z = s[at-2] == 'z';
+    auto cond = compile(0);
     force_eat(",");
-    cld yes = parse(0);
+    auto yes = compile(0);
     force_eat(",");
-    cld no = parsepar();
-    res = real(cond) > 0 ? yes : no;
+    auto no = compile_par();
+    res = [cond, yes, no, z] (cld *v) {
+      cld c = cond(v), y = yes(v), n = no(v);
+      return (z ? abs(c) < 1e-8 : real(c) > 0) ? y : n;
+      };
     }  
-  else if(eat("ifz(")) {
-    cld cond = parse(0);
-    force_eat(",");
-    cld yes = parse(0);
-    force_eat(",");
-    cld no = parsepar();
-    res = abs(cond) < 1e-8 ? yes : no;
-    }
   else if(eat("wallif(")) {
-    cld val0 = parse(0);
+    auto val0 = compile(0);
     force_eat(",");
-    cld val1 = parsepar();
-    if(real(extra_params["p"]) >= 3.5) res = val0;
-    else res = val1;
+    auto val1 = compile_par();
+    exp_code p;
+    if(!find_variable("p", p)) p = exp_constant(extra_params["p"]);
+    res = [val0, val1, p] (cld *v) { 
+      cld v0 = val0(v), v1 = val1(v);
+      return real(p(v)) >= 3.5 ? v0 : v1;
+      };
     }
   else if(eat("rgb(")) {     
-    cld val0 = parse(0);
+    auto val0 = compile(0);
     force_eat(",");
-    cld val1 = parse(0);
+    auto val1 = compile(0);
     force_eat(",");
-    cld val2 = parsepar();
-    switch(int(real(extra_params["p"]) + .5)) {
-      case 1: res = val0; break;
-      case 2: res = val1; break;
-      case 3: res = val2; break;
-      default: res = 0;
-      }
+    auto val2 = compile_par();
+    exp_code p;
+    if(!find_variable("p", p)) p = exp_constant(extra_params["p"]);
+    res = [val0, val1, val2, p] (cld *v) {
+      cld v0 = val0(v), v1 = val1(v), v2 = val2(v);
+      switch(int(real(p(v)) + .5)) {
+        case 1: return v0;
+        case 2: return v1;
+        case 3: return v2;
+        default: return cld(0);
+        }
+      };
     }
   else if(eat("let(")) {
     string name = next_token();
     force_eat("=");
-    cld val = parse(0);
+    auto val = compile(0);
     force_eat(",");
-    dynamicval<cld> d(extra_params[name], val);
-    res = parsepar();
+    int k = slot_count++;
+    slot_names.emplace_back(name, k);
+    auto body = compile_par();
+    slot_names.pop_back();
+    res = [val, body, k] (cld *v) { v[k] = val(v); return body(v); };
     }
   #if CAP_TEXTURE
   else if(eat("txp(")) {
-    cld val = parsepar();
-    res = texture::get_txp(real(val), imag(val), int(real(extra_params["p"]) + .5)-1);
+    auto val = compile_par();
+    exp_code p;
+    if(!find_variable("p", p)) p = exp_constant(extra_params["p"]);
+    res = [val, p] (cld *v) { 
+      cld x = val(v);
+      return cld(texture::get_txp(real(x), imag(x), int(real(p(v)) + .5)-1));
+      };
     }
   #endif
-  else if(next() == '(') at++, res = parsepar(); 
+  else if(next() == '(') at++, res = compile_par(); 
   else {
     string number = next_token();
-    if (auto *p = hr::at_or_null(extra_params, number)) res = *p;
-    else if (auto *p = hr::at_or_null(params, number)) res = (*p)->get_cld();
-    else if(number == "e") res = exp(1);
-    else if(number == "i") res = cld(0, 1);
-    else if(number == "inf") res = HUGE_VAL;
-    else if(number == "p" || number == "pi") res = M_PI;
-    else if(number == "" && next() == '-') { at++; res = -parse(20); }
+    if(find_variable(number, res)) ;
+    else if (auto *p = hr::at_or_null(params, number)) {
+      setting *sett = p->get();
+      res = [sett] (cld*) { return sett->get_cld(); };
+      }
+    else if(number == "e") res = exp_constant(exp(1));
+    else if(number == "i") res = exp_constant(cld(0, 1));
+    else if(number == "inf") res = exp_constant(HUGE_VAL);
+    else if(number == "p" || number == "pi") res = exp_constant(M_PI);
+    else if(number == "" && next() == '-') { at++; res = exp_unary(compile(20), [] (cld x) { return -x; }); }
     else if(number == "") throw hr_parse_exception("number missing, " + where());
-    else if(number == "s") res = ticks / 1000.;
-    else if(number == "ms") res = ticks;
-    else if(number[0] == '0' && number[1] == 'x') res = strtoll(number.c_str()+2, NULL, 16);
-    else if(number == "mousex") res = mousex;
-    else if(number == "deg") res = degree;
-    else if(number == "ultra_mirror_dist") res = cgi.ultra_mirror_dist;
-    else if(number == "psl_steps") res = cgi.psl_steps;
-    else if(number == "single_step") res = cgi.single_step;
-    else if(number == "step") res = hdist0(tC0(currentmap->adj(cwt.at, 0)));
-    else if(number == "edgelen") res = hdist(get_corner_position(cwt.at, 0), get_corner_position(cwt.at, 1));
-    else if(number == "mousey") res = mousey;
-    else if(number == "random") res = randd();
-    else if(number == "mousez") res = cld(mousex - current_display->xcenter, mousey - current_display->ycenter) / cld(current_display->radius, 0);
-    else if(number == "shot") res = inHighQual ? 1 : 0;
+    else if(number == "s") res = [] (cld*) { return cld(ticks / 1000.); };
+    else if(number == "ms") res = [] (cld*) { return cld(ticks); };
+    else if(number[0] == '0' && number[1] == 'x') res = exp_constant(strtoll(number.c_str()+2, NULL, 16));
+    else if(number == "mousex") res = [] (cld*) { return cld(mousex); };
+    else if(number == "deg") res = exp_constant(degree);
+    else if(number == "ultra_mirror_dist") res = [] (cld*) { return cld(cgi.ultra_mirror_dist); };
+    else if(number == "psl_steps") res = [] (cld*) { return cld(cgi.psl_steps); };
+    else if(number == "single_step") res = [] (cld*) { return cld(cgi.single_step); };
+    else if(number == "step") res = [] (cld*) { return cld(hdist0(tC0(currentmap->adj(cwt.at, 0)))); };
+    else if(number == "edgelen") res = [] (cld*) { return cld(hdist(get_corner_position(cwt.at, 0), get_corner_position(cwt.at, 1))); };
+    else if(number == "mousey") res = [] (cld*) { return cld(mousey); };
+    else if(number == "random") res = [] (cld*) { return cld(randd()); };
+    else if(number == "mousez") res = [] (cld*) { return cld(mousex - current_display->xcenter, mousey - current_display->ycenter) / cld(current_display->radius, 0); };
+    else if(number == "shot") res = [] (cld*) { return cld(inHighQual ? 1 : 0); };
     #if CAP_ARCM
-    else if(number == "fake_edgelength") res = arcm::fake_current.edgelength;
+    else if(number == "fake_edgelength") res = [] (cld*) { return cld(arcm::fake_current.edgelength); };
     #endif
-    else if(number == "MAX_EDGE") res = FULL_EDGE;
-    else if(number == "MAX_VALENCE") res = 120;
+    else if(number == "MAX_EDGE") res = exp_constant(FULL_EDGE);
+    else if(number == "MAX_VALENCE") res = exp_constant(120);
     else if(number[0] >= 'a' && number[0] <= 'z') throw hr_parse_exception("unknown value: " + number);
     else if(number[0] >= 'A' && number[0] <= 'Z') throw hr_parse_exception("unknown value: " + number);
     else if(number[0] == '_') throw hr_parse_exception("unknown value: " + number);
-    else { std::stringstream ss; res = 0; ss << number; ss >> res; }
+    else { std::stringstream ss; cld x = 0; ss << number; ss >> x; res = exp_constant(x); }
     }
   while(true) {
     skip_white();
     #if CAP_ANIMATIONS
     if(next() == '.' && next(1) == '.' && prio == 0) {
-      static const cld NO_DERIVATIVE(3.1, 2.5);
-      vector<array<cld, 4>> rest = { make_array(res, NO_DERIVATIVE, res, NO_DERIVATIVE) };
+      /* null codes stand for NO_DERIVATIVE */
+      vector<array<exp_code, 4>> rest = { make_array(res, exp_code(), res, exp_code()) };
       bool second = true;
       while(next() == '.' && next(1) == '.') {
         /* spline interpolation */
         if(next(2) == '/') {
           at += 3;
-          rest.back()[second ? 3 : 1] = parse(10);
+          rest.back()[second ? 3 : 1] = compile(10);
           continue;
           }
         /* sharp end */
         else if(next(2) == '|') {
           at += 3;
-          rest.back()[2] = parse(10);
-          rest.back()[3] = NO_DERIVATIVE;
+          rest.back()[2] = compile(10);
+          rest.back()[3] = exp_code();
           second = true;
           continue;
           }
         at += 2; 
-        auto val = parse(10);
-        rest.emplace_back(make_array(val, NO_DERIVATIVE, val, NO_DERIVATIVE));
+        auto val = compile(10);
+        rest.emplace_back(make_array(val, exp_code(), val, exp_code()));
         second = false;
         }
-      ld v = ticks * (isize(rest)-1.) / anims::period;
-      int vf = v;
-      v -= vf;
-      if(isize(rest) == 1) rest.push_back(rest[0]);
-      vf %= (isize(rest)-1);
-      auto& lft = rest[vf];
-      auto& rgt = rest[vf+1];
-      if(lft[3] == NO_DERIVATIVE && rgt[1] == NO_DERIVATIVE)
-        res = lerp(lft[2], rgt[0], v);
-      else if(rgt[1] == NO_DERIVATIVE)
-        res = lerp(lft[2] + lft[3] * v, rgt[0], v*v);
-      else if(lft[3] == NO_DERIVATIVE)
-        res = lerp(lft[2], rgt[0] + rgt[1] * (v-1), (2-v)*v);
-      else {
-        res = lerp(lft[2] + lft[3] * v, rgt[0] + rgt[1] * (v-1), v*v*(3-2*v));
-        }
-      return res;
+      return [rest] (cld *vars) {
+        static const cld NO_DERIVATIVE(3.1, 2.5);
+        vector<array<cld, 4>> vals;
+        for(auto& r: rest) {
+          vals.emplace_back();
+          for(int j=0; j<4; j++) vals.back()[j] = r[j] ? r[j](vars) : NO_DERIVATIVE;
+          }
+        ld v = ticks * (isize(vals)-1.) / anims::period;
+        int vf = v;
+        v -= vf;
+        if(isize(vals) == 1) vals.push_back(vals[0]);
+        vf %= (isize(vals)-1);
+        auto& lft = vals[vf];
+        auto& rgt = vals[vf+1];
+        if(lft[3] == NO_DERIVATIVE && rgt[1] == NO_DERIVATIVE)
+          return lerp(lft[2], rgt[0], v);
+        else if(rgt[1] == NO_DERIVATIVE)
+          return lerp(lft[2] + lft[3] * v, rgt[0], v*v);
+        else if(lft[3] == NO_DERIVATIVE)
+          return lerp(lft[2], rgt[0] + rgt[1] * (v-1), (2-v)*v);
+        else
+          return lerp(lft[2] + lft[3] * v, rgt[0] + rgt[1] * (v-1), v*v*(3-2*v));
+        };
       }
     else 
     #endif
-    if(next() == '+' && prio <= 10) at++, res = res + parse(20);
-    else if(next() == '-' && prio <= 10) at++, res = res - parse(20);
-    else if(next() == '*' && prio <= 20) at++, res = res * parse(30);
-    else if(next() == '/' && prio <= 20) at++, res = res / parse(30);
-    else if(next() == '^') at++, res = pow(res, parse(40));
+    if(next() == '+' && prio <= 10) { at++; auto a = res, b = compile(20); res = [a, b] (cld *v) { cld x = a(v); return x + b(v); }; }
+    else if(next() == '-' && prio <= 10) { at++; auto a = res, b = compile(20); res = [a, b] (cld *v) { cld x = a(v); return x - b(v); }; }
+    else if(next() == '*' && prio <= 20) { at++; auto a = res, b = compile(30); res = [a, b] (cld *v) { cld x = a(v); return x * b(v); }; }
+    else if(next() == '/' && prio <= 20) { at++; auto a = res, b = compile(30); res = [a, b] (cld *v) { cld x = a(v); return x / b(v); }; }
+    else if(next() == '^') { at++; auto a = res, b = compile(40); res = [a, b] (cld *v) { cld x = a(v); return pow(x, b(v)); }; }
     else break;
     }
   return res;
   }
 
+/** \brief compile the formula s, with the given variables */
+EX exp_program compile_formula(const string& s, const vector<string>& variables IS(vector<string>())) {
+  exp_program prog;
+  exp_parser ep;
+  ep.s = s;
+  prog.variables = variables;
+  for(auto& v: variables) ep.slot_names.emplace_back(v, ep.slot_count++);
+  prog.code = ep.compile();
+  prog.where = ep.where();
+  prog.slots.resize(ep.slot_count);
+  return prog;
+  }
+
 EX ld parseld(const string& s) {
   exp_parser ep;
   ep.s = s;